@@ -2,6 +2,8 @@ require 'mkmf'
 
 if have_library('jiffy', 'jf_init')
   $LDFLAGS << ' -ljiffy'
+  have_func('rb_enc_interned_str', 'ruby.h')
+  have_func('rb_thread_call_without_gvl', 'ruby/thread.h')
   create_makefile("jiffy_parser")
 end
 
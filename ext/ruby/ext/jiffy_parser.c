@@ -26,17 +26,66 @@
  */
 
 #include <ruby.h>
+#include <ruby/encoding.h>
 #include <jiffy/jiffy.h>
+#include <jiffy/tape.h>
+#include <jiffy/writer.h>
+
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+#include <ruby/thread.h>
+#endif /* HAVE_RB_THREAD_CALL_WITHOUT_GVL */
 
 #define UNUSED(x) ((void) (x))
 
+/* string accessors for rubies without RSTRING_PTR() */
+#ifndef RSTRING_PTR
+#define RSTRING_PTR(s) (RSTRING(s)->ptr)
+#define RSTRING_LEN(s) (RSTRING(s)->len)
+#endif /* RSTRING_PTR */
+
 static VALUE mJiffy,
              eError,
              cParser;
 
+static ID id_frozen_keys,
+          id_uminus,
+          id_symbols;
+
+/* token type symbols, indexed by jf_type_t */
+static VALUE type_syms[JF_TYPE_LAST];
+
+/* number of tokens per batch yielded by Parser#parse_batch */
+#define BATCH_TOKENS 256
+
+/*
+ * Parser object: a Jiffy parser, plus a token batch and a reusable
+ * token array for Parser#parse_batch.
+ */
+typedef struct {
+  jf_t parser;
+
+  /* batch storage */
+  jf_token_t tokens[BATCH_TOKENS];
+  uint8_t data[JF_BATCH_DATA_SIZE(BATCH_TOKENS)];
+
+  /* token array passed to the Parser#parse_batch block */
+  VALUE ary;
+} jfr_parser_t;
+
 /**********************/
 /* CONNECTION METHODS */
 /**********************/
+static void 
+jfr_parser_mark(void *conn)
+{
+  jfr_parser_t *rp = (jfr_parser_t*) conn;
+
+  /* mark parse proc and token array */
+  if (rp->parser.user_data)
+    rb_gc_mark((VALUE) rp->parser.user_data);
+  rb_gc_mark(rp->ary);
+}
+
 static void 
 jfr_parser_free(void *conn)
 {
@@ -46,9 +95,10 @@ jfr_parser_free(void *conn)
 static VALUE 
 jfr_parser_s_alloc(VALUE klass)
 {
-  jf_t *parser = ALLOC(jf_t);
-  memset(parser, 0, sizeof(jf_t));
-  return Data_Wrap_Struct(klass, 0, jfr_parser_free, parser);
+  jfr_parser_t *rp = ALLOC(jfr_parser_t);
+  memset(rp, 0, sizeof(jfr_parser_t));
+  rp->ary = Qnil;
+  return Data_Wrap_Struct(klass, jfr_parser_mark, jfr_parser_free, rp);
 }
 
 #ifndef HAVE_RB_DEFINE_ALLOC_FUNC
@@ -81,16 +131,18 @@ jfr_parse_cb(jf_t *p, jf_type_t type, uint8_t *jf_buf, size_t jf_buf_len) {
 static VALUE
 jfr_parser_parse(VALUE self, VALUE str) {
   jf_err_t err;
+  jfr_parser_t *rp;
   jf_t *parser;
   char err_buf[1024];
 
-  Data_Get_Struct(self, jf_t, parser);
+  Data_Get_Struct(self, jfr_parser_t, rp);
+  parser = &(rp->parser);
 
   if (rb_block_given_p())
     parser->user_data = (void*) rb_block_proc();
 
   if (str != Qnil)
-    err = jf_parse(parser, RSTRING(str)->ptr, RSTRING(str)->len);
+    err = jf_parse(parser, (uint8_t*) RSTRING_PTR(str), RSTRING_LEN(str));
   else
     err = jf_parse(parser, 0, 0);
 
@@ -102,12 +154,95 @@ jfr_parser_parse(VALUE self, VALUE str) {
   return INT2FIX(parser->num_bytes);
 }
 
+/*
+ * Parser#parse_batch(str, opts = {}) { |tokens| ... } - Parse a chunk of
+ * JSON data (or pass nil to finish parsing), and yield the tokens in
+ * batches.
+ *
+ * Each batch is a flat array of token types and values: [type, val,
+ * type, val, ...].  The array is reused for every batch, so copy it if
+ * you need to keep it.  Options:
+ *
+ *   :symbols - Yield token types as symbols (e.g. :integer) instead of
+ *              the Jiffy::TYPE_ constants.
+ */
+static VALUE
+jfr_parser_parse_batch(int argc, VALUE *argv, VALUE self) {
+  VALUE str, opts, *types;
+  jfr_parser_t *rp;
+  jf_batch_t batch;
+  jf_token_t *t;
+  size_t i, ofs = 0, len = 0, num_read;
+  const uint8_t *buf = NULL;
+  char err_buf[1024];
+  jf_err_t err;
+
+  Data_Get_Struct(self, jfr_parser_t, rp);
+  rb_scan_args(argc, argv, "11", &str, &opts);
+
+  /* use symbol or integer types */
+  types = (!NIL_P(opts) && RTEST(rb_hash_aref(opts, ID2SYM(id_symbols)))) ? type_syms : NULL;
+
+  if (!NIL_P(str)) {
+    /* take a frozen copy, so the block can't change the input */
+    str = rb_str_new_frozen(StringValue(str));
+    buf = (const uint8_t*) RSTRING_PTR(str);
+    len = RSTRING_LEN(str);
+
+    /* an empty chunk would finish parsing */
+    if (!len)
+      return INT2FIX(rp->parser.num_bytes);
+  }
+
+  /* create token array */
+  if (NIL_P(rp->ary))
+    rp->ary = rb_ary_new2(2 * BATCH_TOKENS);
+
+  /* init batch */
+  batch.tokens = rp->tokens;
+  batch.max_tokens = BATCH_TOKENS;
+  batch.data = rp->data;
+  batch.data_size = sizeof(rp->data);
+
+  do {
+    /* parse next batch */
+    err = jf_parse_batch(&(rp->parser), &batch, buf ? buf + ofs : NULL, len - ofs, &num_read);
+    if (err != JF_OK) {
+      jf_strerror_r(err, err_buf, sizeof(err_buf));
+      rb_raise(eError, "%s", err_buf);
+    }
+
+    ofs += num_read;
+
+    if (!batch.num_tokens)
+      continue;
+
+    /* fill token array */
+    rb_ary_clear(rp->ary);
+    for (i = 0; i < batch.num_tokens; i++) {
+      t = batch.tokens + i;
+      rb_ary_push(rp->ary, types ? types[t->type] : INT2FIX(t->type));
+      rb_ary_push(rp->ary, t->val ? rb_enc_str_new((const char*) t->val, t->len, rb_utf8_encoding()) : Qnil);
+    }
+
+    /* pass batch to block */
+    rb_yield(rp->ary);
+  } while (ofs < len);
+
+  /* keep input alive until here */
+  RB_GC_GUARD(str);
+
+  return INT2FIX(rp->parser.num_bytes);
+}
+
 static VALUE 
 jfr_parser_init(int argc, VALUE *argv, VALUE self)
 {
+  jfr_parser_t *rp;
   jf_t *parser;
 
-  Data_Get_Struct(self, jf_t, parser);
+  Data_Get_Struct(self, jfr_parser_t, rp);
+  parser = &(rp->parser);
   jf_init(parser, (jf_cb_t) jfr_parse_cb);
 
   if (rb_block_given_p()) {
@@ -121,16 +256,597 @@ jfr_parser_init(int argc, VALUE *argv, VALUE self)
 
 static VALUE
 jfr_parser_num_bytes(VALUE self) {
-  jf_t *parser;
-  Data_Get_Struct(self, jf_t, parser);
-  return INT2FIX(parser->num_bytes);
+  jfr_parser_t *rp;
+  Data_Get_Struct(self, jfr_parser_t, rp);
+  return INT2FIX(rp->parser.num_bytes);
 }
 
 static VALUE
 jfr_parser_done(VALUE self) {
-  jf_t *parser;
-  Data_Get_Struct(self, jf_t, parser);
-  return INT2FIX(parser->num_bytes);
+  jfr_parser_t *rp;
+  Data_Get_Struct(self, jfr_parser_t, rp);
+  return INT2FIX(rp->parser.num_bytes);
+}
+
+/******************/
+/* DECODE METHODS */
+/******************/
+
+/*
+ * Decoder state.  This lives on the C stack for the duration of
+ * Jiffy.decode(), so the containers and keys below are visible to the
+ * garbage collector without being registered.
+ */
+typedef struct {
+  /* open containers and pending object keys (Qundef if none) */
+  VALUE containers[JF_MAX_STACK_DEPTH],
+        keys[JF_MAX_STACK_DEPTH];
+  size_t depth;
+
+  /* string buffer, reused for every string */
+  VALUE str;
+
+  /* decoded document */
+  VALUE result;
+
+  /* intern object keys? */
+  int frozen_keys;
+} decoder_t;
+
+/*
+ * interned_str() - Get the frozen, deduplicated string with the given
+ * contents.
+ */
+static VALUE
+interned_str(const char *buf, long len) {
+#ifdef HAVE_RB_ENC_INTERNED_STR
+  return rb_enc_interned_str(buf, len, rb_utf8_encoding());
+#else
+  return rb_funcall(rb_enc_str_new(buf, len, rb_utf8_encoding()), id_uminus, 0);
+#endif /* HAVE_RB_ENC_INTERNED_STR */
+}
+
+/*
+ * decode_add() - Add a finished value to the innermost container, or
+ * save it as the result if it's the top-level value.
+ */
+static void
+decode_add(decoder_t *d, VALUE val) {
+  VALUE *key;
+
+  if (!d->depth) {
+    d->result = val;
+    return;
+  }
+
+  if (TYPE(d->containers[d->depth - 1]) == T_ARRAY) {
+    rb_ary_push(d->containers[d->depth - 1], val);
+    return;
+  }
+
+  /* object: the value is either a key or the value of a pending key */
+  key = d->keys + d->depth - 1;
+  if (*key == Qundef) {
+    *key = val;
+  } else {
+    rb_hash_aset(d->containers[d->depth - 1], *key, val);
+    *key = Qundef;
+  }
+}
+
+static jf_err_t 
+jfr_decode_cb(jf_t *p, jf_type_t type, const uint8_t *buf, const size_t len) {
+  decoder_t *d = (decoder_t*) p->user_data;
+  const char *s;
+  long n;
+
+  switch (type) {
+  case JF_TYPE_BGN_OBJECT:
+  case JF_TYPE_BGN_ARRAY:
+    d->containers[d->depth] = (type == JF_TYPE_BGN_OBJECT) ? rb_hash_new() : rb_ary_new();
+    d->keys[d->depth] = Qundef;
+    d->depth++;
+
+    break;
+  case JF_TYPE_END_OBJECT:
+  case JF_TYPE_END_ARRAY:
+    d->depth--;
+    decode_add(d, d->containers[d->depth]);
+
+    break;
+  case JF_TYPE_BGN_STRING:
+    rb_str_set_len(d->str, 0);
+
+    break;
+  case JF_TYPE_STRING_FRAGMENT:
+    rb_str_cat(d->str, (const char*) buf, len);
+
+    break;
+  case JF_TYPE_END_STRING:
+    s = RSTRING_PTR(d->str);
+    n = RSTRING_LEN(d->str);
+
+    /* intern object keys, if requested */
+    if (d->frozen_keys && d->depth && d->keys[d->depth - 1] == Qundef &&
+        TYPE(d->containers[d->depth - 1]) == T_HASH)
+      decode_add(d, interned_str(s, n));
+    else
+      decode_add(d, rb_enc_str_new(s, n, rb_utf8_encoding()));
+
+    break;
+  case JF_TYPE_INTEGER:
+    /* integers which don't fit in 64 bits become bignums */
+    if (p->num.flags & JF_NUM_OVERFLOW)
+      decode_add(d, rb_str_to_inum(rb_str_new((const char*) buf, len), 10, 0));
+    else
+      decode_add(d, LL2NUM(p->num.i));
+
+    break;
+  case JF_TYPE_FLOAT:
+    decode_add(d, rb_float_new(p->num.d));
+
+    break;
+  case JF_TYPE_TRUE:
+    decode_add(d, Qtrue);
+
+    break;
+  case JF_TYPE_FALSE:
+    decode_add(d, Qfalse);
+
+    break;
+  case JF_TYPE_NULL:
+    decode_add(d, Qnil);
+
+    break;
+  default:
+    /* ignore other tokens */
+    break;
+  }
+
+  /* return success */
+  return JF_OK;
+}
+
+/*
+ * decode_direct() - Decode a document while holding the GVL, building
+ * values directly from the token stream.
+ */
+static VALUE
+decode_direct(VALUE str, int frozen_keys) {
+  char err_buf[1024];
+  decoder_t d;
+  jf_err_t err;
+  jf_t parser;
+
+  /* init decoder */
+  d.depth = 0;
+  d.str = rb_str_buf_new(64);
+  d.result = Qnil;
+  d.frozen_keys = frozen_keys;
+
+  /* init parser */
+  jf_init(&parser, jfr_decode_cb);
+  parser.user_data = &d;
+  parser.flags = JF_FLAG_ZERO_COPY | JF_FLAG_CONVERT_NUMBERS;
+
+  /* parse document */
+  if ((err = jf_parse(&parser, (uint8_t*) RSTRING_PTR(str), RSTRING_LEN(str))) != JF_OK ||
+      (err = jf_done(&parser)) != JF_OK) {
+    jf_strerror_r(err, err_buf, sizeof(err_buf));
+    rb_raise(eError, "%s", err_buf);
+  }
+
+  /* keep input and string buffer alive until here */
+  RB_GC_GUARD(str);
+  RB_GC_GUARD(d.str);
+
+  /* return result */
+  return d.result;
+}
+
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+/* 
+ * Inputs at least this big are parsed into a tape without the GVL, so
+ * other threads can run in the meantime (see decode_tape()).
+ */
+#define NOGVL_MIN_LEN (256 * 1024)
+
+/* number of bytes parsed between checks for interrupts */
+#define NOGVL_WINDOW (1024 * 1024)
+
+/*
+ * Tape job: parses a document into a tape without the GVL.  The parser
+ * must be the first member (see tape_job_cb()).
+ */
+typedef struct {
+  jf_t parser;
+  jf_tape_t tape;
+
+  /* callback installed by jf_tape_init() */
+  jf_cb_t tape_cb;
+
+  /* input, and number of bytes parsed so far */
+  const uint8_t *buf;
+  size_t len, ofs;
+
+  /* result, done flag, and integer overflow flag */
+  jf_err_t err;
+  int done, overflow;
+
+  /* set by tape_job_stop() to interrupt the job */
+  volatile int interrupted;
+} tape_job_t;
+
+static jf_err_t
+tape_job_cb(jf_t *p, jf_type_t type, const uint8_t *buf, const size_t len) {
+  tape_job_t *job = (tape_job_t*) p;
+
+  /* the tape stores integers which don't fit in 64 bits as doubles */
+  if (type == JF_TYPE_INTEGER && (p->num.flags & JF_NUM_OVERFLOW))
+    job->overflow = 1;
+
+  return job->tape_cb(p, type, buf, len);
+}
+
+/*
+ * tape_job_run() - Parse the input in windows until it's done, an
+ * error occurs, or the job is interrupted.  Runs without the GVL.
+ */
+static void *
+tape_job_run(void *arg) {
+  tape_job_t *job = (tape_job_t*) arg;
+  size_t n;
+
+  while (!job->interrupted) {
+    if (job->ofs == job->len) {
+      /* finish parsing */
+      job->err = jf_done(&(job->parser));
+      job->done = 1;
+      break;
+    }
+
+    /* parse next window */
+    n = (job->len - job->ofs < NOGVL_WINDOW) ? job->len - job->ofs : NOGVL_WINDOW;
+    if ((job->err = jf_parse(&(job->parser), job->buf + job->ofs, n)) != JF_OK) {
+      job->done = 1;
+      break;
+    }
+
+    job->ofs += n;
+  }
+
+  return NULL;
+}
+
+static void
+tape_job_stop(void *arg) {
+  ((tape_job_t*) arg)->interrupted = 1;
+}
+
+/*
+ * tape_value() - Build the Ruby value at the given tape index.
+ */
+static VALUE
+tape_value(const jf_tape_t *t, size_t i, int frozen_keys) {
+  const char *s;
+  size_t j, end, len;
+  VALUE r, key;
+
+  switch (jf_tape_type(t, i)) {
+  case JF_TAPE_OBJECT:
+    r = rb_hash_new();
+
+    for (j = i + 1, end = jf_tape_next(t, i) - 1; j < end; j = jf_tape_next(t, j)) {
+      s = (const char*) jf_tape_string(t, j, &len);
+      key = frozen_keys ? interned_str(s, len) : rb_enc_str_new(s, len, rb_utf8_encoding());
+      j = jf_tape_next(t, j);
+      rb_hash_aset(r, key, tape_value(t, j, frozen_keys));
+    }
+
+    return r;
+  case JF_TAPE_ARRAY:
+    r = rb_ary_new();
+
+    for (j = i + 1, end = jf_tape_next(t, i) - 1; j < end; j = jf_tape_next(t, j))
+      rb_ary_push(r, tape_value(t, j, frozen_keys));
+
+    return r;
+  case JF_TAPE_STRING:
+    s = (const char*) jf_tape_string(t, i, &len);
+    return rb_enc_str_new(s, len, rb_utf8_encoding());
+  case JF_TAPE_INTEGER:
+    return LL2NUM(jf_tape_int(t, i));
+  case JF_TAPE_FLOAT:
+    return rb_float_new(jf_tape_float(t, i));
+  case JF_TAPE_TRUE:
+    return Qtrue;
+  case JF_TAPE_FALSE:
+    return Qfalse;
+  default:
+    return Qnil;
+  }
+}
+
+/* arguments for decode_tape_body() */
+typedef struct {
+  tape_job_t *job;
+  int frozen_keys;
+} decode_tape_args_t;
+
+static VALUE
+decode_tape_body(VALUE arg) {
+  decode_tape_args_t *args = (decode_tape_args_t*) arg;
+  tape_job_t *job = args->job;
+  char err_buf[1024];
+
+  /* parse without the GVL, handling interrupts between windows */
+  while (!job->done) {
+    job->interrupted = 0;
+    rb_thread_call_without_gvl(tape_job_run, job, tape_job_stop, job);
+    rb_thread_check_ints();
+  }
+
+  if (job->err != JF_OK) {
+    jf_strerror_r(job->err, err_buf, sizeof(err_buf));
+    rb_raise(eError, "%s", err_buf);
+  }
+
+  /* build values from tape (or let the caller fall back on overflow) */
+  return job->overflow ? Qundef : tape_value(&(job->tape), 0, args->frozen_keys);
+}
+
+static VALUE
+decode_tape_free(VALUE arg) {
+  jf_tape_free(&(((decode_tape_args_t*) arg)->job->tape));
+  return Qnil;
+}
+
+/*
+ * decode_tape() - Decode a large document by parsing it into a tape
+ * without the GVL, then building the values from the tape with the
+ * GVL.  Returns Qundef if the document has integers which don't fit in
+ * 64 bits, since the tape doesn't store those exactly.
+ */
+static VALUE
+decode_tape(VALUE str, int frozen_keys) {
+  decode_tape_args_t args;
+  tape_job_t job;
+  VALUE r;
+
+  /* init job */
+  memset(&job, 0, sizeof(tape_job_t));
+  jf_tape_init(&(job.tape), &(job.parser));
+  job.tape_cb = job.parser.cb;
+  job.parser.cb = tape_job_cb;
+  job.buf = (const uint8_t*) RSTRING_PTR(str);
+  job.len = RSTRING_LEN(str);
+
+  /* run job, and free the tape even if an exception is raised */
+  args.job = &job;
+  args.frozen_keys = frozen_keys;
+  r = rb_ensure(decode_tape_body, (VALUE) &args, decode_tape_free, (VALUE) &args);
+
+  /* keep input alive until here */
+  RB_GC_GUARD(str);
+
+  return r;
+}
+#endif /* HAVE_RB_THREAD_CALL_WITHOUT_GVL */
+
+/*
+ * Jiffy.decode(str, opts = {}) - Decode a JSON document.
+ *
+ * Values are built directly from the token stream, without calling
+ * any Ruby code.  Large documents are parsed without holding the GVL,
+ * so other threads keep running.  Options:
+ *
+ *   :frozen_keys - Return object keys as frozen, deduplicated strings.
+ */
+static VALUE
+jfr_s_decode(int argc, VALUE *argv, VALUE self) {
+  VALUE str, opts, r;
+  int frozen_keys;
+
+  UNUSED(self);
+
+  rb_scan_args(argc, argv, "11", &str, &opts);
+  StringValue(str);
+  frozen_keys = !NIL_P(opts) && RTEST(rb_hash_aref(opts, ID2SYM(id_frozen_keys)));
+
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+  if (RSTRING_LEN(str) >= NOGVL_MIN_LEN) {
+    /* take a frozen copy, so other threads can't change the input */
+    str = rb_str_new_frozen(str);
+
+    if ((r = decode_tape(str, frozen_keys)) != Qundef)
+      return r;
+  }
+#endif /* HAVE_RB_THREAD_CALL_WITHOUT_GVL */
+
+  r = decode_direct(str, frozen_keys);
+
+  /* keep input alive until here */
+  RB_GC_GUARD(str);
+
+  return r;
+}
+
+/******************/
+/* ENCODE METHODS */
+/******************/
+
+/* size of the writer buffer, and initial size of the result string */
+#define ENCODE_BUF_SIZE 16384
+
+static jf_err_t
+jfr_encode_flush_cb(jf_writer_t *w, const uint8_t *buf, const size_t len) {
+  /* append writer buffer to result string */
+  rb_str_cat(*((VALUE*) w->user_data), (const char*) buf, len);
+  return JF_OK;
+}
+
+/*
+ * encode_check() - Raise a Jiffy::Error if a writer call failed.
+ */
+static void
+encode_check(jf_err_t err) {
+  char err_buf[1024];
+
+  if (err != JF_OK) {
+    jf_strerror_r(err, err_buf, sizeof(err_buf));
+    rb_raise(eError, "%s", err_buf);
+  }
+}
+
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+/*
+ * encode_is_number() - Is the given text a single valid JSON number?
+ */
+static int
+encode_is_number(const uint8_t *buf, size_t len) {
+  size_t i = 0;
+
+  /* optional minus sign */
+  if (i < len && buf[i] == '-')
+    i++;
+
+  /* integer part, without leading zeros */
+  if (i < len && buf[i] == '0') {
+    i++;
+  } else if (i < len && IS_DIGIT(buf[i])) {
+    while (i < len && IS_DIGIT(buf[i]))
+      i++;
+  } else {
+    return 0;
+  }
+
+  /* optional fraction */
+  if (i < len && buf[i] == '.') {
+    if (++i >= len || !IS_DIGIT(buf[i]))
+      return 0;
+    while (i < len && IS_DIGIT(buf[i]))
+      i++;
+  }
+
+  /* optional exponent */
+  if (i < len && (buf[i] == 'e' || buf[i] == 'E')) {
+    if (++i < len && (buf[i] == '+' || buf[i] == '-'))
+      i++;
+    if (i >= len || !IS_DIGIT(buf[i]))
+      return 0;
+    while (i < len && IS_DIGIT(buf[i]))
+      i++;
+  }
+
+  /* nothing else */
+  return i == len;
+}
+
+static void encode_value(jf_writer_t *, VALUE);
+
+static int
+encode_pair(VALUE key, VALUE val, VALUE arg) {
+  jf_writer_t *w = (jf_writer_t*) arg;
+
+  if (TYPE(key) != T_STRING)
+    rb_raise(eError, "non-string key values are not allowed");
+
+  /* write key and value */
+  encode_check(jf_writer_key(w, (uint8_t*) RSTRING_PTR(key), RSTRING_LEN(key)));
+  encode_value(w, val);
+
+  return ST_CONTINUE;
+}
+
+/*
+ * encode_value() - Write a Ruby value (and any values it contains).
+ */
+static void
+encode_value(jf_writer_t *w, VALUE val) {
+  VALUE str;
+  long i;
+
+  switch (TYPE(val)) {
+  case T_STRING:
+    encode_check(jf_writer_string(w, (uint8_t*) RSTRING_PTR(val), RSTRING_LEN(val)));
+    break;
+  case T_FIXNUM:
+    encode_check(jf_writer_int(w, FIX2LONG(val)));
+    break;
+  case T_BIGNUM:
+    str = rb_big2str(val, 10);
+    encode_check(jf_writer_number(w, (uint8_t*) RSTRING_PTR(str), RSTRING_LEN(str)));
+    break;
+  case T_FLOAT:
+    encode_check(jf_writer_double(w, RFLOAT_VALUE(val)));
+    break;
+  case T_TRUE:
+  case T_FALSE:
+    encode_check(jf_writer_bool(w, val == Qtrue));
+    break;
+  case T_NIL:
+    encode_check(jf_writer_null(w));
+    break;
+  case T_ARRAY:
+    encode_check(jf_writer_begin_array(w));
+    for (i = 0; i < RARRAY_LEN(val); i++)
+      encode_value(w, rb_ary_entry(val, i));
+    encode_check(jf_writer_end_array(w));
+    break;
+  case T_HASH:
+    encode_check(jf_writer_begin_object(w));
+    rb_hash_foreach(val, encode_pair, (VALUE) w);
+    encode_check(jf_writer_end_object(w));
+    break;
+  default:
+    /* 
+     * other numbers (e.g. BigDecimal) are written with to_s, as long
+     * as that is a valid JSON number (so not Infinity, NaN, a
+     * Rational, or a Complex)
+     */
+    if (!rb_obj_is_kind_of(val, rb_cNumeric))
+      rb_raise(eError, "invalid object type: %s", rb_obj_classname(val));
+
+    str = rb_obj_as_string(val);
+    if (!encode_is_number((uint8_t*) RSTRING_PTR(str), RSTRING_LEN(str)))
+      rb_raise(eError, "invalid number: %s (%s)", StringValueCStr(str), rb_obj_classname(val));
+
+    encode_check(jf_writer_number(w, (uint8_t*) RSTRING_PTR(str), RSTRING_LEN(str)));
+  }
+}
+
+/*
+ * Jiffy.encode(val) - Encode a Ruby value as JSON (wrapped in
+ * parentheses).
+ *
+ * The value is written with a jf_writer_t, whose buffer is appended to
+ * the result string whenever it fills up.
+ */
+static VALUE
+jfr_s_encode(VALUE self, VALUE val) {
+  uint8_t buf[ENCODE_BUF_SIZE];
+  VALUE str;
+  jf_writer_t w;
+
+  UNUSED(self);
+
+  /* create result string */
+  str = rb_str_buf_new(ENCODE_BUF_SIZE);
+  rb_str_cat(str, "(", 1);
+
+  /* init writer */
+  encode_check(jf_writer_init_ex(&w, buf, sizeof(buf), jfr_encode_flush_cb));
+  w.user_data = &str;
+
+  /* write value and flush writer */
+  encode_value(&w, val);
+  encode_check(jf_writer_done(&w));
+  rb_str_cat(str, ")", 1);
+
+  /* return result */
+  rb_enc_associate(str, rb_utf8_encoding());
+  return str;
 }
 
 void Init_jiffy_parser(void) {
@@ -162,7 +878,7 @@ void Init_jiffy_parser(void) {
 
 
   eError = rb_define_class_under(mJiffy, "Error", rb_eStandardError);
-  cParser = rb_define_class_under(mJiffy, "Parser", rb_cData);
+  cParser = rb_define_class_under(mJiffy, "Parser", rb_cObject);
 
 #ifdef HAVE_RB_DEFINE_ALLOC_FUNC
   rb_define_alloc_func(cParser, jfr_parser_s_alloc);
@@ -172,5 +888,27 @@ void Init_jiffy_parser(void) {
 
   rb_define_method(cParser, "initialize", jfr_parser_init, -1);
   rb_define_method(cParser, "parse", jfr_parser_parse, 1);
+  rb_define_method(cParser, "parse_batch", jfr_parser_parse_batch, -1);
   rb_define_method(cParser, "num_bytes", jfr_parser_num_bytes, 0);
+
+  /* token type symbols for Parser#parse_batch */
+  id_symbols = rb_intern("symbols");
+  type_syms[JF_TYPE_BGN_OBJECT] = ID2SYM(rb_intern("bgn_object"));
+  type_syms[JF_TYPE_END_OBJECT] = ID2SYM(rb_intern("end_object"));
+  type_syms[JF_TYPE_BGN_ARRAY] = ID2SYM(rb_intern("bgn_array"));
+  type_syms[JF_TYPE_END_ARRAY] = ID2SYM(rb_intern("end_array"));
+  type_syms[JF_TYPE_BGN_STRING] = ID2SYM(rb_intern("bgn_string"));
+  type_syms[JF_TYPE_STRING_FRAGMENT] = ID2SYM(rb_intern("string_fragment"));
+  type_syms[JF_TYPE_END_STRING] = ID2SYM(rb_intern("end_string"));
+  type_syms[JF_TYPE_INTEGER] = ID2SYM(rb_intern("integer"));
+  type_syms[JF_TYPE_FLOAT] = ID2SYM(rb_intern("float"));
+  type_syms[JF_TYPE_TRUE] = ID2SYM(rb_intern("true"));
+  type_syms[JF_TYPE_FALSE] = ID2SYM(rb_intern("false"));
+  type_syms[JF_TYPE_NULL] = ID2SYM(rb_intern("null"));
+  type_syms[JF_TYPE_END_DOCUMENT] = ID2SYM(rb_intern("end_document"));
+
+  id_frozen_keys = rb_intern("frozen_keys");
+  id_uminus = rb_intern("-@");
+  rb_define_singleton_method(mJiffy, "decode", jfr_s_decode, -1);
+  rb_define_singleton_method(mJiffy, "encode", jfr_s_encode, 1);
 }
@@ -41,11 +41,6 @@ module Jiffy
     end
   end
 
-  def self.encode(val)
-    DocumentParser.encode(val)
-  end
-
-  def self.decode(str)
-    DocumentParser.decode(str)
-  end
+  # Jiffy.encode and Jiffy.decode are implemented natively in
+  # jiffy_parser
 end
@@ -0,0 +1,215 @@
+#ifndef JIFFY_BIND_H
+#define JIFFY_BIND_H
+
+/*
+ * Jiffy - Fast, lighweight, and reentrant JSON stream parser.
+ *
+ * Copyright (C) 2009 Paul Duncan <pabs@pablotron.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h> /* for offsetof() */
+#include <jiffy/jiffy.h>
+
+/*
+ * Jiffy binder: parse a JSON object straight into a C struct.
+ *
+ * The layout of the struct is described by a table of fields, each
+ * with a member name, a type, and the offset of the member in the
+ * struct.  Object members without a field (and null values) are
+ * skipped, so the struct members keep whatever values they had.
+ *
+ * Field types:
+ *
+ *   JF_BIND_INT: int64_t (integers only)
+ *   JF_BIND_INT32: int32_t (integers only)
+ *   JF_BIND_DOUBLE: double (integers or floats)
+ *   JF_BIND_BOOL: int (true or false)
+ *   JF_BIND_STRING: fixed-size char array (null-terminated)
+ *   JF_BIND_STRING_PTR: char pointer to a null-terminated string in
+ *     the caller-supplied arena
+ *   JF_BIND_OBJECT: nested struct, described by another descriptor
+ *   JF_BIND_ARRAY: fixed-size array of structs, described by another
+ *     descriptor, plus a size_t element count
+ *
+ * Parsing fails with JF_ERR_INVALID_BIND if a value doesn't match the
+ * type of its field or is out of range, and with
+ * JF_ERR_STORAGE_TOO_SMALL if a string doesn't fit in its char array
+ * or the arena, or if an array has too many elements.
+ */
+
+/*
+ * jf_bind_type_t - Field types.
+ */
+typedef enum {
+  JF_BIND_INT,
+  JF_BIND_INT32,
+  JF_BIND_DOUBLE,
+  JF_BIND_BOOL,
+  JF_BIND_STRING,
+  JF_BIND_STRING_PTR,
+  JF_BIND_OBJECT,
+  JF_BIND_ARRAY,
+  JF_BIND_LAST
+} jf_bind_type_t;
+
+typedef struct jf_bind_desc_t_ jf_bind_desc_t;
+
+/*
+ * jf_bind_field_t - Field descriptor (see the JF_BIND_FIELD() macros
+ * below).
+ */
+typedef struct {
+  /* object member name */
+  const char *name;
+
+  /* field type */
+  jf_bind_type_t type;
+
+  /* offset of field in struct */
+  size_t ofs;
+
+  /* size of char array (JF_BIND_STRING), or number of elements (JF_BIND_ARRAY) */
+  size_t size;
+
+  /* offset of size_t element count in struct (JF_BIND_ARRAY only) */
+  size_t count_ofs;
+
+  /* struct descriptor (JF_BIND_OBJECT and JF_BIND_ARRAY only) */
+  jf_bind_desc_t *desc;
+} jf_bind_field_t;
+
+/*
+ * jf_bind_desc_t - Struct descriptor (see JF_BIND_DESC()).
+ */
+struct jf_bind_desc_t_ {
+  /* size of struct */
+  size_t size;
+
+  /* fields */
+  const jf_bind_field_t *fields;
+  size_t num_fields;
+
+  /* key map of member names, and is it built yet? (private, see bind.c) */
+  jf_keymap_t keymap;
+  int state;
+};
+
+/*
+ * Field descriptor macros: name is the object member name, s is the
+ * struct type, and m is the struct member.
+ */
+#define JF_BIND_FIELD(name, s, m, type) \
+  { (name), (type), offsetof(s, m), 0, 0, NULL }
+
+#define JF_BIND_STRING_FIELD(name, s, m) \
+  { (name), JF_BIND_STRING, offsetof(s, m), sizeof(((s*) 0)->m), 0, NULL }
+
+#define JF_BIND_OBJECT_FIELD(name, s, m, desc) \
+  { (name), JF_BIND_OBJECT, offsetof(s, m), 0, 0, (desc) }
+
+/* count is the struct member which holds the element count */
+#define JF_BIND_ARRAY_FIELD(name, s, m, count, desc) \
+  { (name), JF_BIND_ARRAY, offsetof(s, m), \
+    sizeof(((s*) 0)->m) / sizeof(((s*) 0)->m[0]), offsetof(s, count), (desc) }
+
+/*
+ * Struct descriptor initializer: s is the struct type, and fields is
+ * an array of field descriptors.
+ */
+#define JF_BIND_DESC(s, fields) \
+  { sizeof(s), (fields), sizeof(fields) / sizeof((fields)[0]), { 0 }, 0 }
+
+/*
+ * Maximum nesting of bound objects and arrays.
+ */
+#define JF_BIND_MAX_DEPTH 32
+
+/*
+ * jf_bind_frame_t - Bound object or array (private).
+ */
+typedef struct {
+  /* struct descriptor, and array field (arrays only) */
+  const jf_bind_desc_t *desc;
+  const jf_bind_field_t *array;
+
+  /* struct (or struct containing array) */
+  uint8_t *base;
+} jf_bind_frame_t;
+
+/*
+ * jf_bind_t - Binder state.
+ */
+typedef struct {
+  /* string arena (public, read-only) */
+  uint8_t *arena;
+  size_t arena_size, arena_len;
+
+  /************************/
+  /* private binder state */
+  /************************/
+
+  /* root struct and descriptor (private) */
+  jf_bind_desc_t *desc;
+  void *dst;
+
+  /* bound objects and arrays (private) */
+  jf_bind_frame_t frames[JF_BIND_MAX_DEPTH];
+  size_t depth;
+
+  /* field of next member value (private) */
+  const jf_bind_field_t *field;
+
+  /* current string (private) */
+  uint8_t *str;
+  size_t str_len, str_size;
+
+  /* parser key buffer (private) */
+  jf_key_buf_t key_buf;
+} jf_bind_t;
+
+/*
+ * jf_bind_init() - Bind a parser to the given struct.
+ *
+ * This calls jf_init() on the parser.  Pass the JSON object to the
+ * parser with jf_parse() as usual; once jf_done() succeeds, the struct
+ * holds the values of the bound members.  JF_BIND_STRING_PTR strings
+ * are saved in the given arena (which may be NULL if there are none),
+ * which must remain valid as long as the struct is used.
+ *
+ * Descriptors are prepared the first time they are used, so bind at
+ * least once before sharing descriptors between threads.  Returns
+ * JF_ERR_INVALID_KEYMAP if a descriptor has duplicate or too many
+ * member names.
+ */
+jf_err_t jf_bind_init(jf_bind_t *, jf_t *, jf_bind_desc_t *, void *, uint8_t *, size_t);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* JIFFY_BIND_H */
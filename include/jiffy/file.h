@@ -0,0 +1,63 @@
+#ifndef JIFFY_FILE_H
+#define JIFFY_FILE_H
+
+/*
+ * Jiffy - Fast, lighweight, and reentrant JSON stream parser.
+ *  
+ * Copyright (C) 2009 Paul Duncan <pabs@pablotron.org>
+ *  
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *   
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the of the
+ * Software.
+ *    
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.  
+ *  
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <jiffy/jiffy.h>
+
+/*
+ * jf_parse_fd() - Parse all of the data from the given file descriptor
+ * with parser, then mark the parser as done.
+ *
+ * Regular files are memory-mapped and passed to jf_parse() in large
+ * windows, with readahead requested for the next window and the pages
+ * of each window dropped once it has been parsed.  Pipes, sockets, and
+ * other file descriptors which can't be mapped are read with read()
+ * into a large buffer instead.
+ *
+ * Returns JF_ERR_IO if the file couldn't be read (check errno for
+ * details), or the result of jf_parse() or jf_done().
+ *
+ * Note: The file descriptor is not closed.
+ */
+jf_err_t jf_parse_fd(jf_t *, int);
+
+/*
+ * jf_parse_file() - Open the given file and parse it with jf_parse_fd().
+ */
+jf_err_t jf_parse_file(jf_t *, const char *);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* JIFFY_FILE_H */
@@ -32,11 +32,11 @@
 extern "C" {
 #endif /* __cplusplus */
 
-#include <stdint.h> /* for uint8_t, uint32_t, size_t */
+#include <stdint.h> /* for uint8_t, uint32_t, int64_t, size_t */
 
 /* 
- * Maximum stack size: this is approxmately the deepest level of 
- * data structure nesting allowed.  
+ * Maximum stack size: this is the deepest level of data structure
+ * nesting allowed.  The stack uses one bit per level of nesting.
  *
  * Note: Reducing this value will reduce memory consumption, but Jiffy
  * will be unable to handle deeply data structures.
@@ -44,6 +44,9 @@ extern "C" {
  * Note: You can lower this value to decrease memory use on embedded
  * systems, but you'll need to recompile Jiffy.
  *
+ * Note: This is the size of the default stack used by jf_init(); use
+ * jf_init_ex() to supply a larger or smaller stack at runtime.
+ *
  */
 #define JF_MAX_STACK_DEPTH  1024
 
@@ -54,9 +57,18 @@ extern "C" {
  * will fragment more frequently and it will reduce the length of the
  * longest literal number string.
  *
+ * Note: This is the size of the default buffer used by jf_init(); use
+ * jf_init_ex() to supply a larger or smaller buffer at runtime.
+ *
  */
 #define JF_MAX_BUF_LEN      128
 
+/* 
+ * Minimum stack and buffer sizes accepted by jf_init_ex().
+ */
+#define JF_MIN_STACK_DEPTH  8
+#define JF_MIN_BUF_LEN      8
+
 typedef struct jf_t_ jf_t;
 
 /* 
@@ -102,7 +114,7 @@ typedef enum {
   JF_ERR_INVALID_TOKEN_EXPECTED_COLON_SPACE, /* expected ':' or ' ' */
   JF_ERR_INVALID_TOKEN_EXPECTED_EXPR, /* expected value */
   JF_ERR_INVALID_TOKEN_EXPECTED_CL_SQ_BRACKET_COMMA_SPACE, /* expected '}', ',', or ' ' */
-  JF_ERR_INVALID_TOKEN_EXPECTED_HEX, /* expected hexadecimal value (0-9 or a-f) */
+  JF_ERR_INVALID_TOKEN_EXPECTED_HEX, /* expected hexadecimal value (0-9, a-f, or A-F) */
   JF_ERR_INVALID_TOKEN_EMBEDDED_CTRL_CHAR, /* embedded control character (e.g. unescaped newline, tab, etc) */
   JF_ERR_INVALID_TOKEN_BAD_UTF8_BYTE, /* invalid UTF-8 byte */
   JF_ERR_INVALID_TOKEN_BAD_ESCAPE_CHAR,  /* invalid backslash escape  */
@@ -110,6 +122,16 @@ typedef enum {
   /* misc errors */
   JF_ERR_NUMBER_TOO_BIG, /* number string too long for buffer */
   JF_STOP, /* callback returned error */
+  JF_ERR_STORAGE_TOO_SMALL, /* stack, buffer, or batch too small */
+  JF_ERR_OUT_OF_MEMORY, /* out of memory */
+  JF_ERR_INVALID_PATH, /* invalid path expression or too many paths */
+  JF_ERR_IO, /* I/O error (check errno) */
+  JF_ERR_INVALID_CHECKPOINT, /* invalid or incompatible checkpoint */
+  JF_ERR_INVALID_TOKEN_UNPAIRED_SURROGATE, /* unpaired UTF-16 surrogate in \u escape */
+  JF_ERR_INVALID_WRITE, /* invalid writer call (e.g. value without key, or NaN) */
+  JF_ERR_INVALID_KEYMAP, /* duplicate, too long, or too many keys in key map */
+  JF_ERR_INVALID_BIND, /* value doesn't match bound field type, or is out of range */
+  JF_SKIP, /* callback skipped value (see jf_cb_t) */
 
   /* last error */
   JF_ERR_LAST
@@ -141,6 +163,14 @@ typedef enum {
   JF_TYPE_FALSE,
   JF_TYPE_NULL,
 
+  /* end of top-level value (JF_FLAG_NDJSON only) */
+  JF_TYPE_END_DOCUMENT,
+
+  /* object key tokens (JF_FLAG_KEY_TOKENS only) */
+  JF_TYPE_BGN_KEY,
+  JF_TYPE_KEY_FRAGMENT,
+  JF_TYPE_END_KEY,
+
   JF_TYPE_LAST
 } jf_type_t;
 
@@ -150,8 +180,289 @@ typedef enum {
  */
 #define JF_FLAG_IGNORE_RFC3629 (1 << 0)
 
+/* 
+ * Send runs of unescaped string characters as string fragments which
+ * point directly into the buffer passed to jf_parse(), instead of 
+ * copying them to the internal buffer first.  Enable this flag to
+ * reduce the number of callbacks and the amount of copying for 
+ * documents with long strings.
+ *
+ * Note: With this flag enabled string fragments can be any length, and
+ * they are only valid until the buffer passed to jf_parse() is 
+ * modified or freed.  Escape sequences are still decoded to the 
+ * internal buffer.
+ */
+#define JF_FLAG_ZERO_COPY (1 << 1)
+
+/* 
+ * Convert numbers to binary as they are parsed.  With this flag
+ * enabled, the `num` member of the parser context (or the `num` 
+ * member of each token in a batch) holds the value of each 
+ * JF_TYPE_INTEGER and JF_TYPE_FLOAT token, so callbacks don't have to
+ * convert the number text themselves.  Conversion doesn't depend on
+ * the decimal point of the current locale (see LC_NUMERIC).
+ */
+#define JF_FLAG_CONVERT_NUMBERS (1 << 2)
+
+/* 
+ * Accept a stream of top-level values (e.g. newline-delimited JSON)
+ * instead of a single value.  With this flag enabled, the parser 
+ * emits a JF_TYPE_END_DOCUMENT token after each top-level value, and
+ * an empty stream is not an error.
+ */
+#define JF_FLAG_NDJSON (1 << 3)
+
+/* 
+ * Send object keys as JF_TYPE_BGN_KEY, JF_TYPE_KEY_FRAGMENT, and
+ * JF_TYPE_END_KEY tokens instead of string tokens, so callbacks can
+ * tell keys and values apart.  With this flag enabled, the parser also
+ * hashes each key as it is scanned: the `key_hash` member of the
+ * parser context holds the hash of the current key (FNV-1a of the 
+ * decoded bytes, see jf_key_hash()) and the `key_id` member holds its
+ * ID in the attached key map or key table (see jf_set_keymap() and
+ * jf_set_keys()) when the JF_TYPE_END_KEY token is sent.
+ */
+#define JF_FLAG_KEY_TOKENS (1 << 4)
+
+/* 
+ * Number was too large: integers are saturated to INT64_MIN or
+ * INT64_MAX, and floating point values are infinite.
+ */
+#define JF_NUM_OVERFLOW (1 << 0)
+
+/* 
+ * jf_num_t - Binary value of a number (see JF_FLAG_CONVERT_NUMBERS).
+ */
+typedef struct {
+  /* integer value (JF_TYPE_INTEGER only) */
+  int64_t i;
+
+  /* floating point value (JF_TYPE_INTEGER and JF_TYPE_FLOAT) */
+  double d;
+
+  /* conversion flags (e.g. JF_NUM_OVERFLOW) */
+  uint32_t flags;
+} jf_num_t;
+
+/* 
+ * Minimum number of tokens in a batch passed to jf_parse_batch().
+ */
+#define JF_MIN_BATCH_TOKENS 8
+
+/* 
+ * Extra room needed in the data of a batch passed to jf_parse_batch(),
+ * beyond the size of the parser buffer: a single input byte can flush
+ * a full buffer and then send one more character (e.g. a held
+ * surrogate).  JF_MIN_BATCH_DATA is the minimum for a parser with the
+ * default buffer.
+ *
+ * Note: a batch is full as soon as it can't hold another full buffer,
+ * so with only JF_MIN_BATCH_DATA bytes every copied value (e.g. each
+ * number, or each escaped string) ends the batch.  Use
+ * JF_BATCH_DATA_SIZE() to size the data for a whole batch of tokens.
+ */
+#define JF_BATCH_DATA_SLACK 4
+#define JF_MIN_BATCH_DATA (JF_MAX_BUF_LEN + JF_BATCH_DATA_SLACK)
+
+/* 
+ * Suggested size of the data of a batch of the given number of tokens
+ * for a parser with the default buffer: room for 16 bytes per token,
+ * plus JF_MIN_BATCH_DATA.
+ */
+#define JF_BATCH_DATA_SIZE(num_tokens) ((num_tokens) * 16 + JF_MIN_BATCH_DATA)
+
+/* 
+ * jf_token_t - Token record filled in by jf_parse_batch().
+ */
+typedef struct {
+  /* token type */
+  jf_type_t type;
+
+  /* byte offset of token in stream */
+  size_t ofs;
+
+  /* token value (NULL for tokens without a value) */
+  const uint8_t *val;
+  size_t len;
+
+  /* binary value of number tokens (see JF_FLAG_CONVERT_NUMBERS) */
+  jf_num_t num;
+
+  /* hash and ID of object key (JF_TYPE_END_KEY only) */
+  uint32_t key_hash, key_id;
+} jf_token_t;
+
+/* 
+ * jf_batch_t - Token batch filled in by jf_parse_batch().
+ */
+typedef struct {
+  /* token array (caller-supplied) */
+  jf_token_t *tokens;
+  size_t max_tokens, num_tokens;
+
+  /* storage for values copied from the parser buffer (caller-supplied) */
+  uint8_t *data;
+  size_t data_size, data_len;
+} jf_batch_t;
+
+/* 
+ * Maximum number of steps in a path expression, and maximum number of
+ * paths in a filter.
+ */
+#define JF_MAX_PATH_STEPS 16
+#define JF_MAX_PATHS      32
+
+/* 
+ * jf_path_step_type_t - Path expression step types.
+ */
+typedef enum {
+  JF_PATH_STEP_KEY,   /* object member (e.g. ".name" or "['name']") */
+  JF_PATH_STEP_INDEX, /* array element (e.g. "[3]") */
+  JF_PATH_STEP_ANY,   /* any member or element (e.g. ".*" or "[*]") */
+  JF_PATH_STEP_LAST
+} jf_path_step_type_t;
+
+/* 
+ * jf_path_step_t - One step of a compiled path expression.
+ */
+typedef struct {
+  /* step type */
+  jf_path_step_type_t type;
+
+  /* member name (JF_PATH_STEP_KEY only; points into the expression) */
+  const uint8_t *key;
+
+  /* length of member name, or element index (JF_PATH_STEP_INDEX) */
+  size_t len;
+} jf_path_step_t;
+
+/* 
+ * jf_path_t - Compiled path expression (see jf_path_compile()).
+ */
+typedef struct {
+  jf_path_step_t steps[JF_MAX_PATH_STEPS];
+  size_t num_steps;
+} jf_path_t;
+
+/* 
+ * jf_filter_t - Path filter (see jf_filter_init()).
+ */
+typedef struct {
+  /* index of path matched by current value (public, read-only) */
+  size_t match;
+
+  /************************/
+  /* private filter state */
+  /************************/
+
+  /* compiled paths (private) */
+  const jf_path_t *paths;
+  size_t num_paths;
+
+  /* are we inside a matched value, and at what depth did it start? (private) */
+  uint8_t emit;
+  size_t emit_depth;
+
+  /* paths which match the current object key so far (private) */
+  uint32_t key_mask;
+  size_t key_len;
+
+  /* live paths and array element count at each level of nesting (private) */
+  uint32_t mask[JF_MAX_PATH_STEPS + 1];
+  size_t index[JF_MAX_PATH_STEPS + 1];
+} jf_filter_t;
+
+/* 
+ * Maximum number of keys in a key table or key map, total length of
+ * the keys in a key table, and length of the longest key which can be
+ * added to a key table or key map.
+ *
+ * Note: You can change these values to trade memory for more keys, but
+ * you'll need to recompile Jiffy.  JF_MAX_KEYS must be a power of 2,
+ * and less than 32768.
+ */
+#define JF_MAX_KEYS         256
+#define JF_MAX_KEYS_LEN     4096
+#define JF_MAX_KEY_LEN      64
+
+/* 
+ * Key ID of keys which aren't in the key table (see jf_set_keys()).
+ */
+#define JF_KEY_NONE         0xffffffff
+
+/* 
+ * jf_keys_t - Key table (see jf_keys_init()).
+ */
+typedef struct {
+  /* number of keys in table (public, read-only) */
+  size_t num_keys;
+
+  /*********************/
+  /* private key table */
+  /*********************/
+
+  /* hash and end offset of each key, by ID (private) */
+  uint32_t hashes[JF_MAX_KEYS];
+  uint32_t ends[JF_MAX_KEYS];
+
+  /* hash index: key ID + 1 for each slot, or 0 for empty slots (private) */
+  uint16_t slots[2 * JF_MAX_KEYS];
+
+  /* key names (private) */
+  uint8_t data[JF_MAX_KEYS_LEN];
+} jf_keys_t;
+
+/* 
+ * jf_keymap_t - Key map (see jf_keymap_init()).
+ */
+typedef struct {
+  /* number of keys in map (public, read-only) */
+  size_t num_keys;
+
+  /*******************/
+  /* private key map */
+  /*******************/
+
+  /* number of buckets, and displacement of each bucket (private) */
+  size_t num_buckets;
+  uint16_t disps[JF_MAX_KEYS];
+
+  /* hash, index, and name of the key in each slot (private) */
+  uint32_t hashes[JF_MAX_KEYS];
+  uint16_t ids[JF_MAX_KEYS];
+  const uint8_t *keys[JF_MAX_KEYS];
+  size_t lens[JF_MAX_KEYS];
+} jf_keymap_t;
+
+/* 
+ * jf_key_buf_t - Space for the object key being scanned, for key table
+ * and key map lookups (see jf_set_keys() and jf_set_keymap()).  Each
+ * parser needs its own.
+ */
+typedef struct {
+  /* current object key (private) */
+  uint8_t buf[JF_MAX_KEY_LEN];
+
+  /* length of current object key, even past JF_MAX_KEY_LEN (private) */
+  size_t len;
+} jf_key_buf_t;
+
 /* 
  * jf_cb_t - Parser callback prototype.
+ *
+ * A callback returns JF_OK to continue, or an error (e.g. JF_STOP) to
+ * stop parsing.  It can also return JF_SKIP to skip the rest of the
+ * value which the token starts:
+ *
+ *   JF_TYPE_BGN_OBJECT, JF_TYPE_BGN_ARRAY, JF_TYPE_BGN_STRING: skip the
+ *     contents of the object, array, or string, including the end
+ *     token
+ *   JF_TYPE_END_KEY (or JF_TYPE_END_STRING of a key): skip the value
+ *     of the object member
+ *
+ * Skipped values are consumed with the same fast scanner as unmatched
+ * values in a path filter (see jf_set_filter()), and none of their
+ * tokens are sent.  JF_SKIP is treated as JF_OK for other tokens.
  */
 typedef jf_err_t (*jf_cb_t)(jf_t *, jf_type_t, const uint8_t  *, const size_t);
 
@@ -171,17 +482,53 @@ struct jf_t_ {
   /* number of bytes parsed (public, read-only) */
   size_t num_bytes;
 
+  /* value of current number (public, read-only, see JF_FLAG_CONVERT_NUMBERS) */
+  jf_num_t num;
+
+  /* hash and ID of current object key (public, read-only, see JF_FLAG_KEY_TOKENS) */
+  uint32_t key_hash, key_id;
+
   /************************/
   /* private parser state */
   /************************/
 
-  /* state stack (private) */
-  char stack[JF_MAX_STACK_DEPTH];
-  size_t sp;
+  /* current batch, if any (private) */
+  jf_batch_t *batch;
+
+  /* path filter, if any, and skipped container depth (private) */
+  jf_filter_t *filter;
+  size_t skip_depth;
+
+  /* key table or key map, if any, and current object key (private) */
+  jf_keys_t *keys;
+  const jf_keymap_t *keymap;
+  jf_key_buf_t *key_buf;
+
+  /* current state, top-level final state, and key flag (private) */
+  uint8_t state, top, key;
+
+  /* UTF-8 validator state (private) */
+  uint8_t utf8;
+
+  /* \u escape value and pending high surrogate, if any (private) */
+  uint16_t hex, surrogate;
+
+  /* container stack, one bit per level of nesting (private) */
+  uint8_t *stack;
+  size_t stack_size, depth;
 
   /* string/number buffer (private) */
-  uint8_t buf[JF_MAX_BUF_LEN];
-  size_t buf_len;
+  uint8_t *buf;
+  size_t buf_size, buf_len;
+
+  /* number accumulator (private) */
+  uint64_t num_mant;
+  int32_t num_exp, num_exp10;
+  uint8_t num_digits, num_trunc, num_neg, num_exp_neg;
+
+  /* default stack and buffer used by jf_init() (private) */
+  uint8_t stack_mem[(JF_MAX_STACK_DEPTH + 7) / 8];
+  uint8_t buf_mem[JF_MAX_BUF_LEN];
 };
 
 /* 
@@ -205,9 +552,29 @@ jf_err_t jf_strerror_r(jf_err_t err, char *buf, size_t buf_len);
 /* 
  * jf_init() - Initialize parser context.
  *
+ * Note: the parser context refers to its own default stack and buffer,
+ * so don't copy it after initialization.
+ *
  */
 void jf_init(jf_t *, jf_cb_t);
 
+/* 
+ * jf_init_ex() - Initialize parser context with a caller-supplied
+ * stack and buffer.
+ *
+ * The stack holds 8 levels of nesting per byte, so its size limits the
+ * deepest level of nesting allowed.  The size of the buffer (in bytes)
+ * limits the longest number and the longest string fragment.  Pass a
+ * NULL pointer to use the default stack or buffer instead.
+ *
+ * Both must remain valid until the parser is finished.  Returns
+ * JF_ERR_STORAGE_TOO_SMALL if the stack holds fewer than
+ * JF_MIN_STACK_DEPTH levels or the buffer is smaller than 
+ * JF_MIN_BUF_LEN.
+ *
+ */
+jf_err_t jf_init_ex(jf_t *, jf_cb_t, void *, size_t, uint8_t *, size_t);
+
 /*
  * jf_parse() - Parse given JSON data with parser.
  *
@@ -216,6 +583,215 @@ void jf_init(jf_t *, jf_cb_t);
  */
 jf_err_t jf_parse(jf_t *, const uint8_t *, const size_t);
 
+/*
+ * jf_parse_batch() - Parse given JSON data with parser, saving tokens
+ * to the given batch instead of calling the parser callback.
+ *
+ * Parsing stops when the input is exhausted or when the batch is
+ * full.  The number of input bytes consumed is saved to the last
+ * parameter; pass the remaining bytes in the next call.
+ *
+ * Token values point either into the input buffer or into the batch
+ * data, so they are valid until the next call to jf_parse_batch() or
+ * until the input buffer is modified, whichever comes first.  Runs of
+ * unescaped string characters are always sent as single fragments,
+ * as if JF_FLAG_ZERO_COPY were set.
+ *
+ * Returns JF_ERR_STORAGE_TOO_SMALL if the batch has room for fewer
+ * than JF_MIN_BATCH_TOKENS tokens or if the batch data isn't at least
+ * JF_BATCH_DATA_SLACK bytes larger than the parser buffer (see
+ * JF_MIN_BATCH_DATA).
+ */
+jf_err_t jf_parse_batch(jf_t *, jf_batch_t *, const uint8_t *, const size_t, size_t *);
+
+/*
+ * jf_validate() - Check whether the given buffer is a valid JSON
+ * document (or stream of documents, if JF_FLAG_NDJSON is set in the
+ * flags) without parsing it.
+ *
+ * Accepts exactly what jf_parse() followed by jf_done() would accept
+ * with the default stack and buffer, but much faster: no tokens are
+ * sent and nothing is copied.  If the buffer is invalid, then the
+ * error code is returned and the offset of the error is saved to the
+ * last parameter (which may be NULL).
+ */
+jf_err_t jf_validate(const uint8_t *, const size_t, const uint32_t, size_t *);
+
+/*
+ * jf_path_compile() - Compile a path expression.
+ *
+ * Path expressions start with "$" (the root value), followed by any
+ * number of the following steps:
+ *
+ *   .name, ['name'], or ["name"]: object member named "name"
+ *   [N]: Nth element of array (starting at 0)
+ *   .* or [*]: any object member or array element
+ *
+ * Member names are matched byte-for-byte against the decoded member
+ * names in the document; no escape sequences are recognized in the
+ * expression.  The compiled path points into the expression, so the
+ * expression must remain valid as long as the path is used.
+ *
+ * Returns JF_ERR_INVALID_PATH if the expression is invalid or has
+ * more than JF_MAX_PATH_STEPS steps.
+ */
+jf_err_t jf_path_compile(jf_path_t *, const char *);
+
+/*
+ * jf_filter_init() - Initialize a path filter with the given array of
+ * compiled paths.
+ *
+ * The paths must remain valid as long as the filter is used.  Returns
+ * JF_ERR_INVALID_PATH if there are more than JF_MAX_PATHS paths.
+ */
+jf_err_t jf_filter_init(jf_filter_t *, const jf_path_t *, size_t);
+
+/*
+ * jf_set_filter() - Attach a path filter to a parser (or detach it, if
+ * the filter is NULL).  Call this before the first call to jf_parse().
+ *
+ * With a filter attached, the parser only emits the tokens of values
+ * which match one of the filter paths.  The `match` member of the
+ * filter holds the index of the matching path while the tokens of a
+ * matched value are emitted.  Values nested inside a matched value are
+ * emitted as part of it and are not matched again.
+ *
+ * Note: Unmatched objects, arrays, and strings are skipped with a fast
+ * scanner that only tracks brackets and quotes, so errors inside them
+ * are not detected.
+ */
+void jf_set_filter(jf_t *, jf_filter_t *);
+
+/*
+ * jf_key_hash() - Get the hash of the given key, as saved to the
+ * `key_hash` member of the parser context (see JF_FLAG_KEY_TOKENS).
+ */
+uint32_t jf_key_hash(const uint8_t *, size_t);
+
+/*
+ * jf_keys_init() - Initialize an empty key table.
+ */
+void jf_keys_init(jf_keys_t *);
+
+/*
+ * jf_keys_add() - Add a key to a key table (if it isn't already there),
+ * and save its ID to the last parameter (which may be NULL).
+ *
+ * Key IDs are assigned in order, starting at 0, and never change, so
+ * adding the keys you expect before parsing lets callbacks switch on
+ * known IDs instead of comparing strings.  Returns
+ * JF_ERR_STORAGE_TOO_SMALL if the key is longer than JF_MAX_KEY_LEN or
+ * the table is full.
+ */
+jf_err_t jf_keys_add(jf_keys_t *, const uint8_t *, size_t, uint32_t *);
+
+/*
+ * jf_keys_get() - Get the key with the given ID from a key table, and
+ * save its length to the last parameter.  Returns NULL if there is no
+ * key with the given ID.
+ *
+ * Note: Returns a pointer into the table which should not be modified.
+ */
+const uint8_t *jf_keys_get(const jf_keys_t *, uint32_t, size_t *);
+
+/*
+ * jf_set_keys() - Attach a key table to a parser (or detach it, if the
+ * key table is NULL), along with the key buffer the parser collects
+ * each object key in.  Call this before the first call to jf_parse(),
+ * or from a callback to switch tables (see jf_set_keymap()).
+ *
+ * With JF_FLAG_KEY_TOKENS set, the parser looks up each object key in
+ * the table and adds the keys it hasn't seen yet, until the table is
+ * full.  The `key_id` member of the parser holds the ID of the key
+ * when the JF_TYPE_END_KEY token is sent, or JF_KEY_NONE if the key
+ * isn't in the table and can't be added.  A table can be shared by
+ * several parsers, as long as they don't run at the same time, so IDs
+ * stay the same from one document to the next, but each parser needs
+ * its own key buffer.
+ */
+void jf_set_keys(jf_t *, jf_keys_t *, jf_key_buf_t *);
+
+/*
+ * jf_keymap_init() - Build a key map for the given array of expected
+ * object keys.
+ *
+ * A key map is a minimal perfect hash of the keys: looking up a key
+ * takes one hash probe and at most one comparison, whether or not the
+ * key is in the map.  Lookups return the index of the key in the array
+ * (or JF_KEY_NONE).  The map points to the keys, so they must remain
+ * valid as long as the map is used.
+ *
+ * Returns JF_ERR_INVALID_KEYMAP if there are more than JF_MAX_KEYS
+ * keys, if a key is longer than JF_MAX_KEY_LEN, or if two keys are the
+ * same (or have the same hash, which is very unlikely).
+ */
+jf_err_t jf_keymap_init(jf_keymap_t *, const char * const *, size_t);
+
+/*
+ * jf_keymap_find() - Get the index of the given key in a key map, or
+ * JF_KEY_NONE if it isn't there.
+ */
+uint32_t jf_keymap_find(const jf_keymap_t *, const uint8_t *, size_t);
+
+/*
+ * jf_set_keymap() - Attach a key map to a parser (or detach it, if the
+ * key map is NULL), along with the key buffer the parser collects each
+ * object key in.  Call this before the first call to jf_parse().
+ *
+ * You can also switch key maps from a callback, e.g. to look up the
+ * keys of a nested object in a different map: each key is looked up in
+ * the key map attached when the key ends, just before the
+ * JF_TYPE_END_KEY token is sent, so the new map applies from the next
+ * key on (or the current one, if it hasn't ended yet).  Keep the same
+ * key buffer while a key is being scanned.
+ *
+ * With JF_FLAG_KEY_TOKENS set, the `key_id` member of the parser holds
+ * the index of each object key in the key map (or JF_KEY_NONE) when the
+ * JF_TYPE_END_KEY token is sent.  The key is hashed as it is scanned,
+ * so the lookup doesn't scan it again.  Key maps aren't changed by the
+ * parser, so several parsers (e.g. on different threads) can share one,
+ * but each parser needs its own key buffer.  A key map takes precedence
+ * over a key table.
+ */
+void jf_set_keymap(jf_t *, const jf_keymap_t *, jf_key_buf_t *);
+
+/*
+ * Version of the checkpoint format written by jf_checkpoint().
+ */
+#define JF_CHECKPOINT_VERSION 5
+
+/*
+ * jf_checkpoint() - Save the state of a parser to the given buffer.
+ *
+ * Call this between calls to jf_parse() (not from a callback).  The
+ * checkpoint records the parser's position (`num_bytes`), so you can
+ * resume parsing later with jf_restore() and the rest of the input,
+ * starting at that offset.  Parser flags, the state of the attached
+ * path filter (if any), and any partial string fragment, object key,
+ * or number are saved too; the callback, user data, storage, and the
+ * contents of the key table are not.
+ *
+ * The size of the checkpoint is saved to the last parameter.  Returns
+ * JF_ERR_STORAGE_TOO_SMALL (and saves the required size) if the buffer
+ * is too small, so you can pass a NULL buffer to get the size.
+ * Checkpoints are compact: typically 25 to 35 bytes, plus 1 byte for
+ * every 8 levels of nesting and the length of any partial value.
+ */
+jf_err_t jf_checkpoint(const jf_t *, uint8_t *, size_t, size_t *);
+
+/*
+ * jf_restore() - Restore the state of a parser from a checkpoint.
+ *
+ * Initialize the parser first (with jf_init() or jf_init_ex()), and
+ * attach the same path filter with jf_set_filter() if the checkpoint
+ * was taken with one.  Attach the same key table or key map too, if
+ * any, or key IDs may not match.
+ * Returns JF_ERR_INVALID_CHECKPOINT if the checkpoint is corrupt or
+ * from an incompatible version, and JF_ERR_STORAGE_TOO_SMALL if it
+ * doesn't fit in the parser's stack or buffer.
+ */
+jf_err_t jf_restore(jf_t *, const uint8_t *, size_t);
+
 /*
  * jf_done() - Mark parser as done.
  * 
@@ -0,0 +1,107 @@
+#ifndef JIFFY_MT_H
+#define JIFFY_MT_H
+
+/*
+ * Jiffy - Fast, lighweight, and reentrant JSON stream parser.
+ *  
+ * Copyright (C) 2009 Paul Duncan <pabs@pablotron.org>
+ *  
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *   
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the of the
+ * Software.
+ *    
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.  
+ *  
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <jiffy/jiffy.h>
+
+/*
+ * Jiffy multithreaded drivers.
+ *
+ * These functions parse a complete buffer on a pool of worker threads,
+ * each with its own parser context, and then deliver the tokens to the
+ * callback of the given parser in order, from the calling thread.  The
+ * callback sees the same token stream that jf_parse() would produce,
+ * with the `num_bytes`, `num`, `key_hash`, and `key_id` members of the
+ * parser set for each token.
+ *
+ * Notes:
+ *   - Call these instead of jf_parse() and jf_done().
+ *   - The parser's JF_FLAG_IGNORE_RFC3629, JF_FLAG_CONVERT_NUMBERS, and
+ *     JF_FLAG_KEY_TOKENS flags and its key map are passed to the
+ *     workers.  Path filters, key tables, and caller-supplied stacks
+ *     and buffers are not.
+ *   - String fragments may point directly into the input buffer (as if
+ *     JF_FLAG_ZERO_COPY were set), so the buffer must remain valid until
+ *     the function returns.
+ *   - Passing 0 threads uses a single worker thread.
+ *   - Values skipped by the callback (see JF_SKIP) are parsed anyway,
+ *     and their tokens are dropped, following the same rules as
+ *     jf_parse() (e.g. keys are never skipped).  Unlike jf_parse(),
+ *     errors inside skipped values are still reported.
+ */
+
+/*
+ * jf_parse_ndjson_mt() - Parse a buffer of newline-delimited JSON
+ * records in parallel.
+ *
+ * The buffer is split into chunks at newlines, and each chunk is parsed
+ * by a worker starting between records.  Tokens are delivered as if the
+ * parser had JF_FLAG_NDJSON set, including a JF_TYPE_END_DOCUMENT token
+ * after each record.
+ *
+ * Records may contain newlines as whitespace (e.g. pretty-printed
+ * records), but then a chunk may start inside a record.  Each chunk is
+ * checked against the parser state at the end of the previous chunk
+ * before it is delivered, as in jf_parse_mt(); if the previous chunk
+ * didn't end between records, then the rest of the buffer is parsed
+ * serially.  Either way, the callback sees the same tokens and errors
+ * as it would from jf_parse().
+ */
+jf_err_t jf_parse_ndjson_mt(jf_t *, const uint8_t *, size_t, size_t);
+
+/*
+ * jf_parse_mt() - Parse a single large JSON document in parallel.
+ *
+ * If the top-level value is an array or object, then the buffer is 
+ * split into chunks at commas in the top-level value.  Finding the
+ * commas takes two quick passes: the first classifies the quotes and
+ * brackets in blocks of the buffer in parallel, and the second (a
+ * prefix scan over the results) finds the exact quote state and 
+ * nesting depth at the start of each block.  Each chunk is then 
+ * parsed by a worker starting just inside the top-level value.
+ *
+ * Each chunk is checked against the parser state at the end of the
+ * previous chunk before it is delivered; if they don't match (which 
+ * can only happen with invalid input), then the rest of the buffer is
+ * parsed serially.  Either way, the callback sees the same tokens and
+ * errors as it would from jf_parse().
+ *
+ * Documents with a scalar top-level value are parsed in one chunk.
+ */
+jf_err_t jf_parse_mt(jf_t *, const uint8_t *, size_t, size_t);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* JIFFY_MT_H */
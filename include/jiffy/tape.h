@@ -0,0 +1,177 @@
+#ifndef JIFFY_TAPE_H
+#define JIFFY_TAPE_H
+
+/*
+ * Jiffy - Fast, lighweight, and reentrant JSON stream parser.
+ *  
+ * Copyright (C) 2009 Paul Duncan <pabs@pablotron.org>
+ *  
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *   
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the of the
+ * Software.
+ *    
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.  
+ *  
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <jiffy/jiffy.h>
+
+/*
+ * Jiffy tape: a DOM built on top of the stream parser.
+ *
+ * A parsed document is stored as a flat array of 64-bit entries (the
+ * "tape") plus a string arena.  Each entry holds a type tag in the top
+ * 8 bits and a payload in the low 56 bits:
+ *
+ *   JF_TAPE_OBJECT, JF_TAPE_ARRAY: index of the entry after the
+ *     matching end entry (i.e. the next sibling)
+ *   JF_TAPE_END_OBJECT, JF_TAPE_END_ARRAY: index of the matching
+ *     begin entry
+ *   JF_TAPE_STRING: offset of the (null-terminated) string in the
+ *     string arena; the next entry holds the string length
+ *   JF_TAPE_INTEGER, JF_TAPE_FLOAT: unused; the next entry holds the
+ *     value (an int64_t, or the bits of a double)
+ *   JF_TAPE_TRUE, JF_TAPE_FALSE, JF_TAPE_NULL: unused
+ *
+ * Object members are stored as a string entry (the key) followed by
+ * the value.  The root value is always at index 0.
+ */
+
+/* 
+ * jf_tape_type_t - Tape entry types.
+ */
+typedef enum {
+  JF_TAPE_OBJECT,
+  JF_TAPE_END_OBJECT,
+  JF_TAPE_ARRAY,
+  JF_TAPE_END_ARRAY,
+  JF_TAPE_STRING,
+  JF_TAPE_INTEGER,
+  JF_TAPE_FLOAT,
+  JF_TAPE_TRUE,
+  JF_TAPE_FALSE,
+  JF_TAPE_NULL,
+  JF_TAPE_LAST
+} jf_tape_type_t;
+
+/* 
+ * Returned by jf_tape_find() and jf_tape_at() if there is no such
+ * member or element.
+ */
+#define JF_TAPE_NONE ((size_t) -1)
+
+/* get the type and payload of a tape entry */
+#define JF_TAPE_ENTRY_TYPE(e) ((jf_tape_type_t) ((e) >> 56))
+#define JF_TAPE_ENTRY_PAYLOAD(e) ((e) & ((((uint64_t) 1) << 56) - 1))
+
+/* 
+ * jf_tape_t - Parsed document.
+ */
+typedef struct {
+  /* tape entries (public, read-only) */
+  uint64_t *tape;
+  size_t tape_len;
+
+  /* string arena (public, read-only) */
+  uint8_t *strings;
+  size_t strings_len;
+
+  /**********************/
+  /* private tape state */
+  /**********************/
+
+  /* allocated sizes (private) */
+  size_t tape_size, strings_size;
+
+  /* indices of open containers (private) */
+  size_t *open;
+  size_t open_len, open_size;
+
+  /* arena offset of current string (private) */
+  size_t str_ofs;
+} jf_tape_t;
+
+/* 
+ * jf_tape_init() - Initialize an empty tape and bind a parser to it.
+ *
+ * This calls jf_init() on the parser.  Pass JSON data to the parser
+ * with jf_parse() as usual; once jf_done() succeeds, the tape holds
+ * the document.
+ */
+void jf_tape_init(jf_tape_t *, jf_t *);
+
+/* 
+ * jf_tape_load() - Parse a complete JSON document into a tape.
+ *
+ * Note: call jf_tape_free() to free the tape, even if this fails.
+ */
+jf_err_t jf_tape_load(jf_tape_t *, const uint8_t *, size_t);
+
+/* 
+ * jf_tape_free() - Free all memory used by a tape.
+ */
+void jf_tape_free(jf_tape_t *);
+
+/* 
+ * jf_tape_type() - Get the type of the entry at the given index.
+ */
+jf_tape_type_t jf_tape_type(const jf_tape_t *, size_t);
+
+/* 
+ * jf_tape_next() - Get the index of the value after the value at the
+ * given index (skipping any nested values) in constant time.
+ */
+size_t jf_tape_next(const jf_tape_t *, size_t);
+
+/* 
+ * jf_tape_find() - Get the index of the value of the member with the
+ * given key in the object at the given index, or JF_TAPE_NONE.
+ */
+size_t jf_tape_find(const jf_tape_t *, size_t, const uint8_t *, size_t);
+
+/* 
+ * jf_tape_at() - Get the index of the Nth element of the array at the
+ * given index, or JF_TAPE_NONE.
+ */
+size_t jf_tape_at(const jf_tape_t *, size_t, size_t);
+
+/* 
+ * jf_tape_string() - Get the null-terminated string at the given
+ * index, and save its length to the last parameter (if not NULL).
+ */
+const uint8_t *jf_tape_string(const jf_tape_t *, size_t, size_t *);
+
+/* 
+ * jf_tape_int() - Get the integer at the given index.
+ */
+int64_t jf_tape_int(const jf_tape_t *, size_t);
+
+/* 
+ * jf_tape_float() - Get the number at the given index as a double
+ * (works for both JF_TAPE_INTEGER and JF_TAPE_FLOAT entries).
+ */
+double jf_tape_float(const jf_tape_t *, size_t);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* JIFFY_TAPE_H */
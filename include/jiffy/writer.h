@@ -0,0 +1,190 @@
+#ifndef JIFFY_WRITER_H
+#define JIFFY_WRITER_H
+
+/*
+ * Jiffy - Fast, lighweight, and reentrant JSON stream parser.
+ *  
+ * Copyright (C) 2009 Paul Duncan <pabs@pablotron.org>
+ *  
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *   
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the of the
+ * Software.
+ *    
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.  
+ *  
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <jiffy/jiffy.h>
+
+/*
+ * Jiffy writer: a streaming JSON encoder.
+ *
+ * Values are written with one call per token, and the writer inserts
+ * the commas and colons between them.  Output goes to the writer
+ * buffer, which either grows as needed (jf_writer_init()) or has a
+ * fixed size and is passed to a flush callback whenever it fills up
+ * (jf_writer_init_ex()).
+ *
+ * Each call checks that the token is allowed at the current point
+ * (e.g. an object member must start with a key), and returns
+ * JF_ERR_INVALID_WRITE if it isn't.  Multiple top-level values are
+ * separated by newlines, which makes an NDJSON stream.
+ */
+
+typedef struct jf_writer_t_ jf_writer_t;
+
+/*
+ * jf_writer_cb_t - Writer flush callback prototype.  Return JF_OK to
+ * continue, or an error (e.g. JF_STOP or JF_ERR_IO) to abort the
+ * current writer call, which returns the error as its result.
+ */
+typedef jf_err_t (*jf_writer_cb_t)(jf_writer_t *, const uint8_t *, const size_t);
+
+/*
+ * Smallest buffer allowed by jf_writer_init_ex(), in bytes.  This is
+ * enough room for the longest number.
+ */
+#define JF_WRITER_MIN_BUF_LEN 32
+
+/*
+ * jf_writer_t - Writer context.
+ */
+struct jf_writer_t_ {
+  /* user data (public, editable at any point) */
+  void *user_data;
+
+  /* output buffer and number of bytes in it (public, read-only) */
+  uint8_t *buf;
+  size_t buf_len;
+
+  /************************/
+  /* private writer state */
+  /************************/
+
+  /* flush callback, or NULL if the buffer is growable (private) */
+  jf_writer_cb_t cb;
+
+  /* size of output buffer (private) */
+  size_t buf_size;
+
+  /* container stack, one bit per level of nesting (private) */
+  uint8_t stack[(JF_MAX_STACK_DEPTH + 7) / 8];
+  size_t depth;
+
+  /* first value in container flag, and key written flag (private) */
+  uint8_t first, key;
+};
+
+/*
+ * jf_writer_init() - Initialize a writer with a growable buffer.
+ *
+ * The buffer is allocated on the first write, and holds all of the
+ * output until jf_writer_free() is called.
+ */
+void jf_writer_init(jf_writer_t *);
+
+/*
+ * jf_writer_init_ex() - Initialize a writer with a caller-supplied
+ * buffer and flush callback.
+ *
+ * The callback is called with the contents of the buffer whenever it
+ * fills up, and by jf_writer_flush() and jf_writer_done().  Returns
+ * JF_ERR_STORAGE_TOO_SMALL if the buffer is smaller than
+ * JF_WRITER_MIN_BUF_LEN.
+ */
+jf_err_t jf_writer_init_ex(jf_writer_t *, uint8_t *, size_t, jf_writer_cb_t);
+
+/*
+ * jf_writer_free() - Free the growable buffer of a writer, if any.
+ */
+void jf_writer_free(jf_writer_t *);
+
+/*
+ * jf_writer_begin_object(), jf_writer_end_object(),
+ * jf_writer_begin_array(), jf_writer_end_array() - Start or finish an
+ * object or array.
+ */
+jf_err_t jf_writer_begin_object(jf_writer_t *);
+jf_err_t jf_writer_end_object(jf_writer_t *);
+jf_err_t jf_writer_begin_array(jf_writer_t *);
+jf_err_t jf_writer_end_array(jf_writer_t *);
+
+/*
+ * jf_writer_key() - Write the key of the next object member.
+ */
+jf_err_t jf_writer_key(jf_writer_t *, const uint8_t *, size_t);
+
+/*
+ * jf_writer_string() - Write a string value.
+ *
+ * Quotes, backslashes, and control characters are escaped; all other
+ * bytes (including UTF-8 sequences) are copied as-is.
+ */
+jf_err_t jf_writer_string(jf_writer_t *, const uint8_t *, size_t);
+
+/*
+ * jf_writer_int() - Write an integer value.
+ */
+jf_err_t jf_writer_int(jf_writer_t *, int64_t);
+
+/*
+ * jf_writer_double() - Write a floating point value, using the fewest
+ * digits that parse back to exactly the same value.  Values from 1e-4
+ * up to 1e16 are written in fixed form, and the rest with an exponent
+ * (e.g. "1.5e-10" or "1e+16").  Integral values in fixed form are
+ * written with a trailing ".0" (e.g. "1.0"), so they parse back as
+ * JF_TYPE_FLOAT.
+ *
+ * Returns JF_ERR_INVALID_WRITE for NaN and infinity, which can't be
+ * represented in JSON.
+ */
+jf_err_t jf_writer_double(jf_writer_t *, double);
+
+/*
+ * jf_writer_number() - Write a number which is already formatted (for
+ * example, an integer too big for jf_writer_int()).  The text is
+ * copied as-is; it isn't checked.
+ */
+jf_err_t jf_writer_number(jf_writer_t *, const uint8_t *, size_t);
+
+/*
+ * jf_writer_bool(), jf_writer_null() - Write true, false, or null.
+ */
+jf_err_t jf_writer_bool(jf_writer_t *, int);
+jf_err_t jf_writer_null(jf_writer_t *);
+
+/*
+ * jf_writer_flush() - Pass the contents of the buffer to the flush
+ * callback and empty the buffer.  Does nothing for a growable buffer.
+ */
+jf_err_t jf_writer_flush(jf_writer_t *);
+
+/*
+ * jf_writer_done() - Check that all objects and arrays have been
+ * closed, then flush the buffer.
+ */
+jf_err_t jf_writer_done(jf_writer_t *);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* JIFFY_WRITER_H */
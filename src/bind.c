@@ -0,0 +1,330 @@
+/*
+ * Jiffy - Fast, lighweight, and reentrant JSON stream parser.
+ *
+ * Copyright (C) 2009 Paul Duncan <pabs@pablotron.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <string.h> /* for memset(), memcpy() */
+#include <jiffy/bind.h>
+
+/*
+ * Descriptor states: not prepared, being prepared by the current call
+ * to jf_bind_init(), and ready.
+ */
+#define DESC_NEW 0
+#define DESC_PREPARING 1
+#define DESC_READY 2
+
+/*
+ * prepare_desc() - Build the key maps of the given descriptor and of
+ * any nested descriptors.  Each descriptor is marked as being prepared
+ * before its nested descriptors are prepared, so recursive descriptors
+ * work (see finish_desc()).
+ */
+static jf_err_t
+prepare_desc(jf_bind_desc_t *d) {
+  const char *names[JF_MAX_KEYS];
+  jf_err_t err;
+  size_t i;
+
+  if (d->state != DESC_NEW)
+    return JF_OK;
+
+  if (d->num_fields > JF_MAX_KEYS)
+    return JF_ERR_INVALID_KEYMAP;
+
+  /* build key map of member names (key IDs are field indices) */
+  for (i = 0; i < d->num_fields; i++)
+    names[i] = d->fields[i].name;
+  if ((err = jf_keymap_init(&(d->keymap), names, d->num_fields)) != JF_OK)
+    return err;
+  d->state = DESC_PREPARING;
+
+  /* prepare nested descriptors */
+  for (i = 0; i < d->num_fields; i++) {
+    if (d->fields[i].desc && (err = prepare_desc(d->fields[i].desc)) != JF_OK)
+      return err;
+  }
+
+  /* return success */
+  return JF_OK;
+}
+
+/*
+ * finish_desc() - Mark the descriptors prepared by prepare_desc() as
+ * ready, or as not prepared if any of them failed, so a descriptor is
+ * never left ready with a nested descriptor that isn't.
+ */
+static void
+finish_desc(jf_bind_desc_t *d, int state) {
+  size_t i;
+
+  if (d->state != DESC_PREPARING)
+    return;
+
+  d->state = state;
+
+  for (i = 0; i < d->num_fields; i++) {
+    if (d->fields[i].desc)
+      finish_desc(d->fields[i].desc, state);
+  }
+}
+
+/*
+ * push_frame() - Start a bound object or array, and look up the keys
+ * of the object (if any) in its descriptor.  The key map is switched
+ * from the callback, between keys (see jf_set_keymap()).
+ */
+static jf_err_t
+push_frame(jf_bind_t *b, jf_t *p, const jf_bind_desc_t *d, const jf_bind_field_t *array, uint8_t *base) {
+  jf_bind_frame_t *f;
+
+  if (b->depth >= JF_BIND_MAX_DEPTH)
+    return JF_ERR_STACK_OVERFLOW;
+
+  f = b->frames + b->depth++;
+  f->desc = d;
+  f->array = array;
+  f->base = base;
+
+  jf_set_keymap(p, array ? NULL : &(d->keymap), &(b->key_buf));
+  b->field = NULL;
+
+  /* return success */
+  return JF_OK;
+}
+
+/*
+ * pop_frame() - End a bound object or array, and go back to looking up
+ * keys in the enclosing object (if any).
+ */
+static void
+pop_frame(jf_bind_t *b, jf_t *p) {
+  const jf_bind_frame_t *f;
+
+  b->depth--;
+  b->field = NULL;
+
+  if (b->depth > 0) {
+    f = b->frames + b->depth - 1;
+    jf_set_keymap(p, f->array ? NULL : &(f->desc->keymap), &(b->key_buf));
+  }
+}
+
+/*
+ * bind_element() - Start the next element of the bound array.
+ */
+static jf_err_t
+bind_element(jf_bind_t *b, jf_t *p, jf_type_t type) {
+  const jf_bind_frame_t *f = b->frames + b->depth - 1;
+  const jf_bind_field_t *a = f->array;
+  size_t *count = (size_t*) (f->base + a->count_ofs);
+
+  switch (type) {
+  case JF_TYPE_BGN_OBJECT:
+    if (*count >= a->size)
+      return JF_ERR_STORAGE_TOO_SMALL;
+
+    return push_frame(b, p, a->desc, NULL, f->base + a->ofs + (*count)++ * a->desc->size);
+  case JF_TYPE_END_ARRAY:
+    pop_frame(b, p);
+    return JF_OK;
+  case JF_TYPE_NULL:
+    /* skip null elements */
+    return JF_OK;
+  default:
+    return JF_ERR_INVALID_BIND;
+  }
+}
+
+/*
+ * bind_value() - Save a value (or the start of one) to the given field
+ * of the struct at base.
+ */
+static jf_err_t
+bind_value(jf_bind_t *b, jf_t *p, const jf_bind_field_t *f, uint8_t *base, jf_type_t type) {
+  uint8_t *dst = base + f->ofs;
+
+  switch (type) {
+  case JF_TYPE_BGN_OBJECT:
+    if (f->type != JF_BIND_OBJECT)
+      return JF_ERR_INVALID_BIND;
+
+    return push_frame(b, p, f->desc, NULL, dst);
+  case JF_TYPE_BGN_ARRAY:
+    if (f->type != JF_BIND_ARRAY)
+      return JF_ERR_INVALID_BIND;
+
+    /* start with an empty array */
+    *((size_t*) (base + f->count_ofs)) = 0;
+
+    return push_frame(b, p, f->desc, f, base);
+  case JF_TYPE_BGN_STRING:
+    if (f->type == JF_BIND_STRING) {
+      b->str = dst;
+      b->str_size = f->size;
+    } else if (f->type == JF_BIND_STRING_PTR) {
+      b->str = b->arena + b->arena_len;
+      b->str_size = b->arena_size - b->arena_len;
+    } else {
+      return JF_ERR_INVALID_BIND;
+    }
+
+    /* make sure there's room for the terminator */
+    if (!b->str_size)
+      return JF_ERR_STORAGE_TOO_SMALL;
+
+    /* keep field until end of string */
+    b->str_len = 0;
+    return JF_OK;
+  case JF_TYPE_INTEGER:
+    if (f->type == JF_BIND_DOUBLE) {
+      memcpy(dst, &(p->num.d), sizeof(double));
+    } else if (f->type == JF_BIND_INT && !(p->num.flags & JF_NUM_OVERFLOW)) {
+      memcpy(dst, &(p->num.i), sizeof(int64_t));
+    } else if (f->type == JF_BIND_INT32 && p->num.i >= INT32_MIN && p->num.i <= INT32_MAX) {
+      *((int32_t*) dst) = (int32_t) p->num.i;
+    } else {
+      return JF_ERR_INVALID_BIND;
+    }
+
+    break;
+  case JF_TYPE_FLOAT:
+    if (f->type != JF_BIND_DOUBLE)
+      return JF_ERR_INVALID_BIND;
+
+    memcpy(dst, &(p->num.d), sizeof(double));
+
+    break;
+  case JF_TYPE_TRUE:
+  case JF_TYPE_FALSE:
+    if (f->type != JF_BIND_BOOL)
+      return JF_ERR_INVALID_BIND;
+
+    *((int*) dst) = (type == JF_TYPE_TRUE);
+
+    break;
+  case JF_TYPE_NULL:
+    /* leave field as-is */
+    break;
+  default:
+    /* never reached */
+    return JF_ERR_INVALID_BIND;
+  }
+
+  /* value is done */
+  b->field = NULL;
+
+  /* return success */
+  return JF_OK;
+}
+
+static jf_err_t
+bind_cb(jf_t *p, jf_type_t type, const uint8_t *val, const size_t len) {
+  jf_bind_t *b = (jf_bind_t*) p->user_data;
+  const jf_bind_frame_t *f;
+
+  switch (type) {
+  case JF_TYPE_BGN_KEY:
+  case JF_TYPE_KEY_FRAGMENT:
+    /* keys are looked up by the parser */
+    return JF_OK;
+  case JF_TYPE_END_KEY:
+    /* skip values of unbound members */
+    if (p->key_id == JF_KEY_NONE)
+      return JF_SKIP;
+
+    b->field = b->frames[b->depth - 1].desc->fields + p->key_id;
+
+    return JF_OK;
+  case JF_TYPE_STRING_FRAGMENT:
+    /* append fragment to string (leaving room for the terminator) */
+    if (len >= b->str_size - b->str_len)
+      return JF_ERR_STORAGE_TOO_SMALL;
+
+    memcpy(b->str + b->str_len, val, len);
+    b->str_len += len;
+
+    return JF_OK;
+  case JF_TYPE_END_STRING:
+    b->str[b->str_len] = '\0';
+
+    /* save arena string */
+    if (b->field->type == JF_BIND_STRING_PTR) {
+      *((char**) (b->frames[b->depth - 1].base + b->field->ofs)) = (char*) b->str;
+      b->arena_len += b->str_len + 1;
+    }
+
+    b->field = NULL;
+
+    return JF_OK;
+  case JF_TYPE_END_OBJECT:
+    pop_frame(b, p);
+    return JF_OK;
+  case JF_TYPE_END_DOCUMENT:
+    return JF_OK;
+  default:
+    break;
+  }
+
+  if (!b->depth) {
+    /* the root value must be an object */
+    if (type != JF_TYPE_BGN_OBJECT)
+      return JF_ERR_INVALID_BIND;
+
+    return push_frame(b, p, b->desc, NULL, (uint8_t*) b->dst);
+  }
+
+  f = b->frames + b->depth - 1;
+
+  /* array element or member value */
+  if (f->array)
+    return bind_element(b, p, type);
+  else
+    return bind_value(b, p, b->field, f->base, type);
+}
+
+jf_err_t
+jf_bind_init(jf_bind_t *b, jf_t *p, jf_bind_desc_t *desc, void *dst, uint8_t *arena, size_t arena_size) {
+  jf_err_t err;
+
+  memset(b, 0, sizeof(jf_bind_t));
+  b->desc = desc;
+  b->dst = dst;
+  b->arena = arena;
+  b->arena_size = arena_size;
+
+  /* bind parser to struct */
+  jf_init(p, bind_cb);
+  p->user_data = b;
+  p->flags = JF_FLAG_ZERO_COPY | JF_FLAG_CONVERT_NUMBERS | JF_FLAG_KEY_TOKENS;
+
+  /* build key maps */
+  err = prepare_desc(desc);
+  finish_desc(desc, (err == JF_OK) ? DESC_READY : DESC_NEW);
+
+  /* return result */
+  return err;
+}
@@ -0,0 +1,173 @@
+/*
+ * Jiffy - Fast, lighweight, and reentrant JSON stream parser.
+ *  
+ * Copyright (C) 2009 Paul Duncan <pabs@pablotron.org>
+ *  
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *   
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the of the
+ * Software.
+ *    
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.  
+ *  
+ */
+
+
+#include <stdlib.h> /* for malloc(), free() */
+#include <errno.h> /* for errno, EINTR */
+#include <fcntl.h> /* for open(), posix_fadvise() */
+#include <unistd.h> /* for read(), lseek(), close() */
+#include <sys/types.h>
+#include <sys/stat.h> /* for fstat() */
+#include <sys/mman.h> /* for mmap(), madvise() */
+#include <jiffy/file.h>
+
+/* 
+ * Number of bytes of a mapped file passed to jf_parse() at once.  This
+ * must be a multiple of the page size.
+ */
+#define MAP_WINDOW (4 * 1024 * 1024)
+
+/* size of read() buffer for files which can't be mapped */
+#define READ_BUF_SIZE (256 * 1024)
+
+/*
+ * ADVISE() - Give the kernel a hint about a range of a mapped file, if
+ * the hint is supported (hints are only hints, so errors are ignored).
+ */
+#define ADVISE(addr, len, advice) ((void) madvise((void*) (addr), (len), (advice)))
+
+/*
+ * parse_mapped() - Parse a mapped file one window at a time.
+ */
+static jf_err_t
+parse_mapped(jf_t *p, const uint8_t *map, size_t len) {
+  size_t ofs, n;
+  jf_err_t err;
+
+#ifdef MADV_SEQUENTIAL
+  /* read ahead aggressively */
+  ADVISE(map, len, MADV_SEQUENTIAL);
+#endif /* MADV_SEQUENTIAL */
+
+  for (ofs = 0; ofs < len; ofs += n) {
+    n = (len - ofs < MAP_WINDOW) ? len - ofs : MAP_WINDOW;
+
+#ifdef MADV_WILLNEED
+    /* start reading the next window while this one is parsed */
+    if (ofs + n < len)
+      ADVISE(map + ofs + n, (len - ofs - n < MAP_WINDOW) ? len - ofs - n : MAP_WINDOW, MADV_WILLNEED);
+#endif /* MADV_WILLNEED */
+
+    if ((err = jf_parse(p, map + ofs, n)) != JF_OK)
+      return err;
+
+#ifdef MADV_DONTNEED
+    /* drop the pages of this window; they won't be needed again */
+    ADVISE(map + ofs, n, MADV_DONTNEED);
+#endif /* MADV_DONTNEED */
+  }
+
+  /* return success */
+  return JF_OK;
+}
+
+/*
+ * parse_read() - Parse a file descriptor with read().
+ */
+static jf_err_t
+parse_read(jf_t *p, int fd) {
+  jf_err_t err = JF_OK;
+  uint8_t *buf;
+  ssize_t n;
+
+  /* allocate read buffer */
+  if ((buf = malloc(READ_BUF_SIZE)) == NULL)
+    return JF_ERR_OUT_OF_MEMORY;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  /* read ahead aggressively (fails harmlessly for pipes) */
+  (void) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif /* POSIX_FADV_SEQUENTIAL */
+
+  while (err == JF_OK) {
+    n = read(fd, buf, READ_BUF_SIZE);
+
+    if (n > 0) {
+      err = jf_parse(p, buf, n);
+    } else if (!n) {
+      /* end of file */
+      break;
+    } else if (errno != EINTR) {
+      err = JF_ERR_IO;
+    }
+  }
+
+  /* free read buffer */
+  free(buf);
+
+  /* return result */
+  return err;
+}
+
+jf_err_t
+jf_parse_fd(jf_t *p, int fd) {
+  struct stat st;
+  void *map;
+  jf_err_t err;
+
+  /* 
+   * map regular files, unless they're empty, too large for the 
+   * address space, or already partially read
+   */
+  if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0 &&
+      (uint64_t) st.st_size <= (size_t) -1 && lseek(fd, 0, SEEK_CUR) == 0) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (map != MAP_FAILED) {
+      err = parse_mapped(p, (const uint8_t*) map, st.st_size);
+      munmap(map, st.st_size);
+
+      return (err == JF_OK) ? jf_done(p) : err;
+    }
+  }
+
+  /* fall back to read() */
+  if ((err = parse_read(p, fd)) != JF_OK)
+    return err;
+
+  /* finish parsing */
+  return jf_done(p);
+}
+
+jf_err_t
+jf_parse_file(jf_t *p, const char *path) {
+  jf_err_t err;
+  int fd;
+
+  /* open file */
+  if ((fd = open(path, O_RDONLY)) == -1)
+    return JF_ERR_IO;
+
+  /* parse file */
+  err = jf_parse_fd(p, fd);
+
+  /* close file */
+  close(fd);
+
+  /* return result */
+  return err;
+}
@@ -26,8 +26,32 @@
  */
 
 #include <string.h> /* for memset() */
+#include <stdlib.h> /* for strtod() */
+#include <stdio.h> /* for sprintf() */
+#include <math.h> /* for HUGE_VAL */
 #include <jiffy/jiffy.h>
 
+/*
+ * Use SSE2 for the block scanners below if the compiler supports it.
+ * SSE2 is part of the base x86-64 instruction set, so there's no need
+ * for runtime CPU detection.  Define JF_NO_SIMD to force the portable
+ * scalar scanners.
+ */
+#if defined(__SSE2__) && !defined(JF_NO_SIMD)
+#define JF_USE_SSE2 1
+#include <emmintrin.h> /* for SSE2 intrinsics */
+#endif /* __SSE2__ && !JF_NO_SIMD */
+
+/*
+ * Also use SSSE3 (if the compiler was told it's available, e.g. with
+ * -mssse3 or -march=native) for table lookups in the UTF-8 validator.
+ * Without SSSE3, the UTF-8 validator uses slower SSE2 range checks.
+ */
+#if defined(JF_USE_SSE2) && defined(__SSSE3__)
+#define JF_USE_SSSE3 1
+#include <tmmintrin.h> /* for SSSE3 intrinsics */
+#endif /* JF_USE_SSE2 && __SSSE3__ */
+
 /*
  * static list of error strings 
  * (automagically generated from json.h; see the jf_err_t enum)
@@ -73,7 +97,7 @@ errors[] = {
   "expected ':' or ' '",
   "expected value",
   "expected '}', ',', or ' '",
-  "expected hexadecimal value (0-9 or a-f)",
+  "expected hexadecimal value (0-9, a-f, or A-F)",
   "embedded control character (e.g. unescaped newline, tab, etc)",
   "invalid UTF-8 byte",
   "invalid backslash escape ",
@@ -81,6 +105,16 @@ errors[] = {
   /* misc errors */
   "number string too long for buffer",
   "callback returned error",
+  "stack, buffer, or batch too small",
+  "out of memory",
+  "invalid path expression or too many paths",
+  "I/O error (check errno)",
+  "invalid or incompatible checkpoint",
+  "unpaired UTF-16 surrogate in \\u escape",
+  "invalid writer call (e.g. value without key, or NaN)",
+  "duplicate, too long, or too many keys in key map",
+  "value doesn't match bound field type, or is out of range",
+  "callback skipped value (not an error)",
 
   /* last error (sentinel) */
   NULL
@@ -120,6 +154,41 @@ void
 jf_init(jf_t *p, jf_cb_t cb) {
   memset(p, 0, sizeof(jf_t));
   p->cb = cb;
+
+  /* use default stack and buffer */
+  p->stack = p->stack_mem;
+  p->stack_size = sizeof(p->stack_mem);
+  p->buf = p->buf_mem;
+  p->buf_size = JF_MAX_BUF_LEN;
+
+  /* no key yet */
+  p->key_id = JF_KEY_NONE;
+}
+
+jf_err_t
+jf_init_ex(jf_t *p, jf_cb_t cb, void *stack, size_t stack_size, uint8_t *buf, size_t buf_size) {
+  jf_init(p, cb);
+
+  /* use caller-supplied stack */
+  if (stack) {
+    if (8 * stack_size < JF_MIN_STACK_DEPTH)
+      return JF_ERR_STORAGE_TOO_SMALL;
+
+    p->stack = (uint8_t*) stack;
+    p->stack_size = stack_size;
+  }
+
+  /* use caller-supplied buffer */
+  if (buf) {
+    if (buf_size < JF_MIN_BUF_LEN)
+      return JF_ERR_STORAGE_TOO_SMALL;
+
+    p->buf = buf;
+    p->buf_size = buf_size;
+  }
+
+  /* return success */
+  return JF_OK;
 }
 
 #if 0
@@ -134,779 +203,3163 @@ jf_done(jf_t *p) {
   return jf_parse(p, 0, 0); 
 }
 
-#define MASK(bits, shift) (((1 << (bits)) - 1) << (shift))
-#define FROM_HEX(c) MASK(4, 0) & (((c) >= '0' && (c) <= '9') ? ((c) - '0') : (((c) - 'a') + 10))
+/*
+ * IS_SPACE() - Is the given byte whitespace?  Matches the same set of
+ * characters as CASE_WHITESPACE (' ', and '\b' through '\r').
+ */
+#define IS_SPACE(c) ((c) == ' ' || ((c) >= '\b' && (c) <= '\r'))
 
-/* FIXME: i don't think this is working right */
-static jf_err_t
-decode_utf8(jf_t *p) {
-  uint8_t *u = p->buf + p->buf_len - 4;
-  uint32_t v;
+/*
+ * IS_DIGIT() - Is the given byte a decimal digit?
+ */
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
 
-  /* decode value */
-  v = (FROM_HEX(u[0]) << 12) | 
-      (FROM_HEX(u[1]) <<  8) |
-      (FROM_HEX(u[2]) <<  4) |
-      (FROM_HEX(u[3])      );
+#ifdef JF_USE_SSE2
+/*
+ * first_bit() - Get the index of the lowest set bit in a non-zero 
+ * movemask result.
+ */
+static size_t
+first_bit(int mask) {
+#ifdef __GNUC__
+  return __builtin_ctz(mask);
+#else
+  size_t r = 0;
+
+  while (!(mask & 1)) {
+    mask >>= 1;
+    r++;
+  }
 
-  /* pop 4 characters from buffer */
-  p->buf_len -= 4;
+  return r;
+#endif /* __GNUC__ */
+}
+#endif /* JF_USE_SSE2 */
 
-  if (v < 0x80) {
-    /* one-byte sequence */
+/*
+ * scan_space() - Return the offset of the first non-whitespace byte in
+ * buf at or after offset i, or len if the rest of the buffer is
+ * whitespace.
+ */
+static size_t
+scan_space(const uint8_t *buf, size_t i, const size_t len) {
+#ifdef JF_USE_SSE2
+  const __m128i sp = _mm_set1_epi8(' '),
+                lo = _mm_set1_epi8('\b'),
+                hi = _mm_set1_epi8('\r' - '\b');
+  __m128i v, d;
+  int mask;
+#endif /* JF_USE_SSE2 */
+
+  /* most whitespace runs are a single byte, so check that first */
+  if (i < len && !IS_SPACE(buf[i]))
+    return i;
+
+#ifdef JF_USE_SSE2
+  for (; i + 16 <= len; i += 16) {
+    v = _mm_loadu_si128((const __m128i*) (buf + i));
+
+    /* match ' ' and (unsigned) v - '\b' <= '\r' - '\b' */
+    d = _mm_sub_epi8(v, lo);
+    d = _mm_cmpeq_epi8(_mm_min_epu8(d, hi), d);
+    d = _mm_or_si128(d, _mm_cmpeq_epi8(v, sp));
+
+    /* look for first non-whitespace byte in block */
+    if ((mask = ~_mm_movemask_epi8(d) & 0xffff) != 0)
+      return i + first_bit(mask);
+  }
+#endif /* JF_USE_SSE2 */
 
-    p->buf[p->buf_len] = (uint8_t) v;
-    p->buf_len += 1;
-  } else if (v < 0x800) {
-    /* two-byte sequence */
+  /* scan remaining bytes */
+  while (i < len && IS_SPACE(buf[i]))
+    i++;
 
-    p->buf[p->buf_len]     = MASK(2, 6) |
-                             ((v & MASK(3, 8)) >> 8) << 2 |
-                             ((v & MASK(2, 6)) >> 6);
-    p->buf[p->buf_len + 1] = (1 << 7) |
-                             (v & MASK(6, 0));
+  return i;
+}
 
-    p->buf_len += 2;
-  } else if (v < 0x10000) {
-    /* three-byte sequence */
-
-    p->buf[p->buf_len]     = MASK(3, 5) | 
-                             (v & MASK(4, 12)) >> 12;
-    p->buf[p->buf_len + 1] = (1 << 7) | 
-                             (v & MASK(4, 8)) >> 6 |
-                             (v & MASK(2, 6)) >> 6;
-    p->buf[p->buf_len + 2] = (1 << 7) | 
-                             (v & MASK(6, 0));
-
-
-    p->buf_len += 3;
-  } else if (v < 0x10ffff) {
-    /* four-byte sequence */
-    /* FIXME: these are impossible, why do i support them? */
-
-    p->buf[p->buf_len]     = MASK(4, 4) | 
-                             (v & MASK(3, 18)) >> 18;
-    p->buf[p->buf_len + 1] = (1 << 7) | 
-                             (v & MASK(2, 16)) >> 12 |
-                             (v & MASK(4, 12)) >> 12;
-    p->buf[p->buf_len + 2] = (1 << 7) | 
-                             (v & MASK(4, 8)) >> 6 | 
-                             (v & MASK(2, 6)) >> 6;
-    p->buf[p->buf_len + 3] = (1 << 7) | 
-                             (v & MASK(6, 0));
-
-    p->buf_len += 4;
-  } else {
-    /* invalid unicode sequence */
+/*
+ * IS_STRING_END() - Does the given byte end a run of ordinary string
+ * characters (double quote, backslash, or control character)?
+ */
+#define IS_STRING_END(c) ((c) < ' ' || (c) == '"' || (c) == '\\')
+
+/*
+ * scan_string() - Return the offset of the first byte in buf at or
+ * after offset i that ends a run of ordinary string characters, or len
+ * if the run continues to the end of the buffer.  The run is not
+ * checked for valid UTF-8; see check_utf8().
+ */
+static size_t
+scan_string(const uint8_t *buf, size_t i, const size_t len) {
+#ifdef JF_USE_SSE2
+  const __m128i quote = _mm_set1_epi8('"'),
+                slash = _mm_set1_epi8('\\'),
+                ctrl  = _mm_set1_epi8(0x1f);
+  __m128i v, d;
+  int mask;
+
+  for (; i + 16 <= len; i += 16) {
+    v = _mm_loadu_si128((const __m128i*) (buf + i));
+
+    /* match double quote, backslash, and (unsigned) v <= 0x1f */
+    d = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash));
+    d = _mm_or_si128(d, _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v));
+
+    if ((mask = _mm_movemask_epi8(d)) != 0)
+      return i + first_bit(mask);
   }
+#endif /* JF_USE_SSE2 */
 
+  /* scan remaining bytes */
+  while (i < len && !IS_STRING_END(buf[i]))
+    i++;
 
-  return JF_OK;
+  return i;
 }
 
-#define PUSH_STATE(ps, state) do {                  \
-  /* check for stack overflow */                    \
-  if ((ps)->sp + 1 >= JF_MAX_STACK_DEPTH)           \
-    return JF_ERR_STACK_OVERFLOW;                   \
-                                                    \
-  /* push state */                                  \
-  (ps)->stack[(ps)->sp] = (state);                  \
-                                                    \
-  /* increment stack pointer */                     \
-  (ps)->sp++;                                       \
-} while (0)
-
-#define POP_STATE(ps) do {                          \
-  /* check for stack underflow */                   \
-  if (!(ps)->sp)                                    \
-    return JF_ERR_STACK_UNDERFLOW;                  \
-                                                    \
-  /* decriment stack pointer */                     \
-  (ps)->sp--;                                       \
-} while (0)
+/*
+ * UTF-8 validator DFA.  Bytes are mapped to one of 12 classes, and
+ * each state has a transition for each class.  State 0 is between
+ * characters; the other states (except UTF8_REJECT) are in the middle
+ * of a multi-byte character, and track the range of the next
+ * continuation byte so that overlong encodings, surrogates (U+D800
+ * through U+DFFF), and values past U+10FFFF are rejected (RFC 3629).
+ */
+#define UTF8_ACCEPT 0
+#define UTF8_REJECT 1
 
-#define SEND_FULL(ps, type, str, str_len) do {      \
-  if ((ps)->cb) {                                   \
-    err = (ps)->cb((ps), (type), (str), (str_len)); \
-                                                    \
-    if (err != JF_OK)                               \
-      return err;                                   \
-  }                                                 \
-} while (0)
+/*
+ * Byte classes:
+ *
+ *   0: 00-7f      4: c0-c1, f5-ff   8: ed
+ *   1: 80-8f      5: c2-df          9: f0
+ *   2: 90-9f      6: e0            10: f1-f3
+ *   3: a0-bf      7: e1-ec, ee-ef  11: f4
+ */
+static const uint8_t
+utf8_classes[256] = {
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 00 */
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 10 */
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 20 */
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 30 */
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 40 */
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 50 */
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 60 */
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, /* 70 */
+   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, /* 80 */
+   2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2, /* 90 */
+   3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3, /* a0 */
+   3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3, /* b0 */
+   4,  4,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5, /* c0 */
+   5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5, /* d0 */
+   6,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  7, /* e0 */
+   9, 10, 10, 10, 11,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4, /* f0 */
+};
 
-#define SEND(ps, type) SEND_FULL(ps, type, 0, 0)
+/*
+ * States:
+ *
+ *   0: between characters   5: after e0 (next is a0-bf)
+ *   1: invalid              6: after ed (next is 80-9f)
+ *   2: 1 byte left          7: after f0 (next is 90-bf)
+ *   3: 2 bytes left         8: after f4 (next is 80-8f)
+ *   4: 3 bytes left
+ */
+static const uint8_t
+utf8_states[9][12] = {
+  /*  00 80 90 a0 c0 c2 e0 e1 ed f0 f1 f4 */
+  {   0, 1, 1, 1, 1, 2, 5, 3, 6, 7, 4, 8 }, /* 0 */
+  {   1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 }, /* 1 */
+  {   1, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1 }, /* 2 */
+  {   1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1 }, /* 3 */
+  {   1, 3, 3, 3, 1, 1, 1, 1, 1, 1, 1, 1 }, /* 4 */
+  {   1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1 }, /* 5 */
+  {   1, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1 }, /* 6 */
+  {   1, 1, 3, 3, 1, 1, 1, 1, 1, 1, 1, 1 }, /* 7 */
+  {   1, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 }, /* 8 */
+};
 
-#define SEND_STRING_FRAGMENT(ps) do {               \
-  if ((ps)->buf_len > 0) {                          \
-    SEND_FULL(                                      \
-      (ps), JF_TYPE_STRING_FRAGMENT,                \
-      (ps)->buf, (ps)->buf_len                      \
-    );                                              \
-                                                    \
-    (ps)->buf_len = 0;                              \
-  }                                                 \
-} while (0)
+#ifdef JF_USE_SSE2
+/*
+ * UTF8_PREV() - Get the bytes of the block v shifted forward by n
+ * bytes, with the last n bytes of the previous block p shifted in.
+ */
+#ifdef JF_USE_SSSE3
+#define UTF8_PREV(v, p, n) _mm_alignr_epi8((v), (p), 16 - (n))
+#else
+#define UTF8_PREV(v, p, n)                          \
+  _mm_or_si128(_mm_slli_si128((v), (n)), _mm_srli_si128((p), 16 - (n)))
+#endif /* JF_USE_SSSE3 */
 
-#define PUSH_CHAR(ps, c) do {                       \
-  if ((ps)->buf_len + 1 >= JF_MAX_BUF_LEN)          \
-    SEND_STRING_FRAGMENT(ps);                       \
-  (ps)->buf[(ps)->buf_len++] = (c);                 \
-} while (0)
+/*
+ * utf8_restart() - Back up from offset i (but not past offset start)
+ * to the lead byte of the character which contains the byte at i - 1,
+ * so the DFA can continue from a character boundary.
+ */
+static size_t
+utf8_restart(const uint8_t *buf, const size_t start, size_t i) {
+  size_t j;
 
-#define PUSH_NUM(ps, c) do {                        \
-  if ((ps)->buf_len + 1 >= JF_MAX_BUF_LEN)          \
-    return JF_ERR_NUMBER_TOO_BIG;                   \
-  (ps)->buf[(ps)->buf_len++] = (c);                 \
-} while (0)
+  /* skip back over continuation bytes, then the lead byte */
+  for (j = 0; j < 3 && i > start && (buf[i - 1] & 0xc0) == 0x80; j++)
+    i--;
+  if (i > start && buf[i - 1] >= 0xc0)
+    i--;
 
-#define CASE_WHITESPACE                             \
-  case ' ':                                         \
-  case '\b':                                        \
-  case '\f':                                        \
-  case '\t':                                        \
-  case '\n':                                        \
-  case '\r':                                        \
-  case '\v':                
+  return i;
+}
+#endif /* JF_USE_SSE2 */
 
-#define CASE_DIGIT                                  \
-  case '0':                                         \
-  case '1':                                         \
-  case '2':                                         \
-  case '3':                                         \
-  case '4':                                         \
-  case '5':                                         \
-  case '6':                                         \
-  case '7':                                         \
-  case '8':                                         \
-  case '9':                 
+#ifdef JF_USE_SSSE3
+/*
+ * Error bits for the SSSE3 UTF-8 validator.  Each pair of adjacent
+ * bytes is classified by three 16-entry table lookups (the high and
+ * low nibbles of the first byte and the high nibble of the second),
+ * and the pair is invalid if all three results share an error bit.
+ * See "Validating UTF-8 In Less Than One Instruction Per Byte" (Keiser
+ * and Lemire, 2021).
+ */
+#define UTF8_TOO_SHORT      (1 << 0) /* lead not followed by continuation */
+#define UTF8_TOO_LONG       (1 << 1) /* continuation after ASCII */
+#define UTF8_OVERLONG_3     (1 << 2) /* e0 80-9f */
+#define UTF8_TOO_LARGE      (1 << 3) /* f4 90-bf, or f5-ff */
+#define UTF8_SURROGATE      (1 << 4) /* ed a0-bf */
+#define UTF8_OVERLONG_2     (1 << 5) /* c0-c1 */
+#define UTF8_TOO_LARGE_1000 (1 << 6) /* f5-ff 80-8f */
+#define UTF8_OVERLONG_4     (1 << 6) /* f0 80-8f */
+#define UTF8_TWO_CONTS      (1 << 7) /* continuation after continuation */
+#define UTF8_CARRY          (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
 
-#define CASE_HEX                                    \
-  CASE_DIGIT                                        \
-  case 'a':                                         \
-  case 'b':                                         \
-  case 'c':                                         \
-  case 'd':                                         \
-  case 'e':                                         \
-  case 'f':
+/*
+ * UTF8_LOOKUP() - Look up the 16-entry table t with the high (shift
+ * = 4) or low (shift = 0) nibbles of the block v.
+ */
+#define UTF8_LOOKUP(t, v, shift)                    \
+  _mm_shuffle_epi8((t), _mm_and_si128(_mm_srli_epi16((v), (shift)), lo_nibble))
 
-#define CASE_END_NUM                                \
-  CASE_WHITESPACE                                   \
-  case ',':                                         \
-  case ']':                                         \
-  case '}':                                         \
-  case ')':
+/*
+ * check_utf8_blocks() - Check the UTF-8 in buf at offset i 16 bytes
+ * at a time, stopping at the first block with an error or when fewer
+ * than 16 bytes remain.  Offset i must be between characters.
+ *
+ * Returns the offset of the start of the last character which began
+ * before the block where checking stopped: everything before it is
+ * valid, and the scalar DFA can pick up from there (in state 0).
+ */
+static size_t
+check_utf8_blocks(const uint8_t *buf, size_t i, const size_t len) {
+  const __m128i lo_nibble = _mm_set1_epi8(0x0f),
+                byte_1_high = _mm_setr_epi8(
+                  /* 0_______ ________: ASCII */
+                  UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+                  UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+
+                  /* 10______ ________: continuation */
+                  UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+
+                  /* 1100____ ________: two byte lead */
+                  UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+
+                  /* 1101____ ________: two byte lead */
+                  UTF8_TOO_SHORT,
+
+                  /* 1110____ ________: three byte lead */
+                  UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+
+                  /* 1111____ ________: four byte lead */
+                  UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4
+                ),
+                byte_1_low = _mm_setr_epi8(
+                  /* ____0000 ________ */
+                  UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+
+                  /* ____0001 ________ */
+                  UTF8_CARRY | UTF8_OVERLONG_2,
+
+                  /* ____001_ ________ */
+                  UTF8_CARRY,
+                  UTF8_CARRY,
+
+                  /* ____0100 ________ */
+                  UTF8_CARRY | UTF8_TOO_LARGE,
+
+                  /* ____0101 ________ through ____1100 ________ */
+                  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+                  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+                  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+                  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+                  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+                  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+                  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+                  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+
+                  /* ____1101 ________ */
+                  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+
+                  /* ____111_ ________ */
+                  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+                  UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000
+                ),
+                byte_2_high = _mm_setr_epi8(
+                  /* ________ 0_______: ASCII */
+                  UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+                  UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+
+                  /* ________ 1000____ */
+                  UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | 
+                  UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+
+                  /* ________ 1001____ */
+                  UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | 
+                  UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+
+                  /* ________ 101_____ */
+                  UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | 
+                  UTF8_SURROGATE | UTF8_TOO_LARGE,
+                  UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | 
+                  UTF8_SURROGATE | UTF8_TOO_LARGE,
+
+                  /* ________ 11______: lead */
+                  UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT
+                ),
+                /* bytes before these must be followed by 2 or 3 continuations */
+                max_2_byte = _mm_set1_epi8((char) (0xe0 - 1)),
+                max_3_byte = _mm_set1_epi8((char) (0xf0 - 1)),
+                high_bit = _mm_set1_epi8((char) 0x80),
+                zero = _mm_setzero_si128();
+  __m128i v, prev = zero, p1, sc, must23;
+  const size_t start = i;
+
+  for (; i + 16 <= len; i += 16) {
+    v = _mm_loadu_si128((const __m128i*) (buf + i));
+
+    /* skip ASCII blocks (unless a character is still incomplete) */
+    if (!_mm_movemask_epi8(_mm_or_si128(v, prev))) {
+      prev = v;
+      continue;
+    }
 
-#define ACCEPT_EXPR(ps, buffer, d)                  \
-  CASE_WHITESPACE                                   \
-    /* ignore whitespace */                         \
-    break;                                          \
-  case '{':                                         \
-    if (d)                                          \
-      PUSH_STATE((ps), (d));                        \
-                                                    \
-    PUSH_STATE((ps), 'o');                          \
-    SEND((ps), JF_TYPE_BGN_OBJECT);                 \
-                                                    \
-    break;                                          \
-  case '[':                                         \
-    if (d)                                          \
-      PUSH_STATE((ps), (d));                        \
-                                                    \
-    PUSH_STATE((ps), 'a');                          \
-    SEND((ps), JF_TYPE_BGN_ARRAY);                  \
-                                                    \
-    break;                                          \
-  case '"':                                         \
-    if (d)                                          \
-      PUSH_STATE((ps), (d));                        \
-                                                    \
-    PUSH_STATE((ps), 's');                          \
-    SEND((ps), JF_TYPE_BGN_STRING);                 \
-                                                    \
-    break;                                          \
-  case 't':                                         \
-    if (d)                                          \
-      PUSH_STATE((ps), (d));                        \
-                                                    \
-    PUSH_STATE((ps), 'T');                          \
-                                                    \
-    break;                                          \
-  case 'f':                                         \
-    if (d)                                          \
-      PUSH_STATE((ps), (d));                        \
-                                                    \
-    PUSH_STATE((ps), 'F');                          \
-                                                    \
-    break;                                          \
-  case 'n':                                         \
-    if (d)                                          \
-      PUSH_STATE((ps), (d));                        \
-                                                    \
-    PUSH_STATE((ps), 'N');                          \
-                                                    \
-    break;                                          \
-  CASE_DIGIT                                        \
-  case '-':                                         \
-    if (d)                                          \
-      PUSH_STATE((ps), (d));                        \
-                                                    \
-    PUSH_STATE((ps), 'n');                          \
-    (ps)->buf_len = 1;                              \
-    (ps)->buf[0] = (buffer)[i];                     \
-                                                    \
-    break;
+    /* check special cases for each pair of adjacent bytes */
+    p1 = UTF8_PREV(v, prev, 1);
+    sc = _mm_and_si128(
+      UTF8_LOOKUP(byte_1_high, p1, 4),
+      UTF8_LOOKUP(byte_1_low, p1, 0)
+    );
+    sc = _mm_and_si128(sc, UTF8_LOOKUP(byte_2_high, v, 4));
+
+    /* third and fourth bytes of longer characters must be continuations */
+    must23 = _mm_or_si128(
+      _mm_subs_epu8(UTF8_PREV(v, prev, 2), max_2_byte),
+      _mm_subs_epu8(UTF8_PREV(v, prev, 3), max_3_byte)
+    );
+    must23 = _mm_and_si128(_mm_cmpgt_epi8(must23, zero), high_bit);
+
+    /* stop at blocks with errors */
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_xor_si128(must23, sc), zero)) != 0xffff)
+      break;
+
+    prev = v;
+  }
 
-#define CHECK_UTF8_BYTE(ps, ch) do {                \
-  if (((ch) > 0x7f) && !((ps)->flags & JF_FLAG_IGNORE_RFC3629)) {  \
-    if (((ch) >= 0xc0 && (ch) <= 0xc1) ||           \
-        ((ch) >= 0xf5 && (ch) <= 0xf7) ||           \
-        ((ch) >= 0xf8 && (ch) <= 0xfb) ||           \
-        ((ch) >= 0xfc && (ch) <= 0xfd) ||           \
-        ((ch) >= 0xfe /* && (ch) <= 0xff */))       \
-      return JF_ERR_INVALID_TOKEN_BAD_UTF8_BYTE;    \
-  }                                                 \
-} while (0)
-  
+  /* back up to a character boundary */
+  return utf8_restart(buf, start, i);
+}
+#elif defined(JF_USE_SSE2)
+/*
+ * UTF8_GE() and UTF8_LE() - Unsigned byte comparisons of the block v
+ * with the block c.
+ */
+#define UTF8_GE(v, c) _mm_cmpeq_epi8(_mm_max_epu8((v), (c)), (v))
+#define UTF8_LE(v, c) _mm_cmpeq_epi8(_mm_min_epu8((v), (c)), (v))
 
-jf_err_t
-jf_parse(jf_t *p, const uint8_t *buf, const size_t buf_len) {
-  size_t i, base;
-  jf_err_t err;
+/*
+ * check_utf8_blocks() - Check the UTF-8 in buf at offset i 16 bytes
+ * at a time, stopping at the first block with an error or when fewer
+ * than 16 bytes remain.  Offset i must be between characters.
+ *
+ * Without SSSE3 there's no byte shuffle for table lookups, so each
+ * byte is checked against the three bytes before it with range
+ * comparisons instead: a byte must be a continuation byte if and only
+ * if it closely follows a lead byte, c0, c1, and f5 through ff are
+ * never valid, and the byte after e0, ed, f0, and f4 must be in range
+ * (to reject overlong encodings, surrogates, and values past
+ * U+10FFFF).
+ *
+ * Returns the offset of the start of the last character which began
+ * before the block where checking stopped: everything before it is
+ * valid, and the scalar DFA can pick up from there (in state 0).
+ */
+static size_t
+check_utf8_blocks(const uint8_t *buf, size_t i, const size_t len) {
+  const __m128i c0 = _mm_set1_epi8((char) 0xc0),
+                e0 = _mm_set1_epi8((char) 0xe0),
+                ed = _mm_set1_epi8((char) 0xed),
+                f0 = _mm_set1_epi8((char) 0xf0),
+                f4 = _mm_set1_epi8((char) 0xf4),
+                f5 = _mm_set1_epi8((char) 0xf5),
+                fe = _mm_set1_epi8((char) 0xfe),
+                x8f = _mm_set1_epi8((char) 0x8f),
+                x90 = _mm_set1_epi8((char) 0x90),
+                x9f = _mm_set1_epi8((char) 0x9f),
+                xa0 = _mm_set1_epi8((char) 0xa0);
+  __m128i v, prev = _mm_setzero_si128(), p1, must, err;
+  const size_t start = i;
+
+  for (; i + 16 <= len; i += 16) {
+    v = _mm_loadu_si128((const __m128i*) (buf + i));
+
+    /* skip ASCII blocks (unless a character is still incomplete) */
+    if (!_mm_movemask_epi8(_mm_or_si128(v, prev))) {
+      prev = v;
+      continue;
+    }
 
-  /* save initial byte count */
-  base = p->num_bytes;
+    /* continuation bytes (signed < -64) must follow lead bytes */
+    p1 = UTF8_PREV(v, prev, 1);
+    must = _mm_or_si128(UTF8_GE(p1, c0), UTF8_GE(UTF8_PREV(v, prev, 2), e0));
+    must = _mm_or_si128(must, UTF8_GE(UTF8_PREV(v, prev, 3), f0));
+    err = _mm_xor_si128(must, _mm_cmplt_epi8(v, c0));
 
-  /* iterate over each character in buffer */
-  for (i = 0; i < buf_len; i++) {
-    /* add to byte count */
-    p->num_bytes = base + i;
+    /* c0, c1, and f5 through ff are never valid */
+    err = _mm_or_si128(err, _mm_cmpeq_epi8(_mm_and_si128(v, fe), c0));
+    err = _mm_or_si128(err, UTF8_GE(v, f5));
 
-retry:
-    if (!p->sp) {
-      /* no state; look for opening parenthesis */
+    /* check range of byte after e0, ed, f0, and f4 */
+    err = _mm_or_si128(err, _mm_and_si128(_mm_cmpeq_epi8(p1, e0), UTF8_LE(v, x9f)));
+    err = _mm_or_si128(err, _mm_and_si128(_mm_cmpeq_epi8(p1, ed), UTF8_GE(v, xa0)));
+    err = _mm_or_si128(err, _mm_and_si128(_mm_cmpeq_epi8(p1, f0), UTF8_LE(v, x8f)));
+    err = _mm_or_si128(err, _mm_and_si128(_mm_cmpeq_epi8(p1, f4), UTF8_GE(v, x90)));
 
-      switch (buf[i]) {
-      ACCEPT_EXPR(p, buf, ' ')
-      case '(':
-        /* push init state */
-        PUSH_STATE(p, 'i');
+    /* stop at blocks with errors */
+    if (_mm_movemask_epi8(err))
+      break;
 
-        break;
-      default:
-        return JF_ERR_INVALID_TOKEN_EXPECTED_PAREN_SPACE_EXPR;
-      }
-    } else {
-      switch (p->stack[p->sp - 1]) {
+    prev = v;
+  }
 
-      /**************/
-      /* init state */
-      /**************/
+  /* back up to a character boundary */
+  return utf8_restart(buf, start, i);
+}
+#endif /* JF_USE_SSSE3 */
 
-      case 'i':
-        switch (buf[i]) {
-        ACCEPT_EXPR(p, buf, 'f')
-        case ')':
-          POP_STATE(p);
-          PUSH_STATE(p, ' ');
+/*
+ * check_utf8() - Check that the bytes in buf from offset i to len are
+ * valid UTF-8, continuing from (and updating) the DFA state at the
+ * given pointer, so a character can span several calls.  Returns the
+ * offset of the first invalid byte, or len if there isn't one.
+ */
+static size_t
+check_utf8(const uint8_t *buf, size_t i, const size_t len, uint8_t *state) {
+  uint8_t s = *state;
+
+#ifdef JF_USE_SSE2
+  /* check whole blocks first */
+  if (s == UTF8_ACCEPT && i + 16 <= len)
+    i = check_utf8_blocks(buf, i, len);
+#endif /* JF_USE_SSE2 */
+
+  for (; i < len; i++) {
+    if (s == UTF8_ACCEPT) {
+#ifdef JF_USE_SSE2
+      /* skip ASCII 16 bytes at a time */
+      for (; i + 16 <= len; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*) (buf + i))))
           break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_PAREN_EXPR;
-        }
+      }
+#endif /* JF_USE_SSE2 */
 
-        break;
+      /* skip remaining ASCII bytes */
+      while (i < len && buf[i] < 0x80)
+        i++;
 
-      /**************/
-      /* fini state */
-      /**************/
+      if (i >= len)
+        break;
+    }
 
-      case 'f':
-        switch (buf[i]) {
-        CASE_WHITESPACE
-          /* ignore whitespace */
-          break;
-        case ')':
-          POP_STATE(p);
-          POP_STATE(p);
-          PUSH_STATE(p, ' ');
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CL_PAREN_SPACE;
-        }
+    /* check byte */
+    s = utf8_states[s][utf8_classes[buf[i]]];
+    if (s == UTF8_REJECT)
+      break;
+  }
 
-        break;
+  /* save state */
+  *state = s;
 
-      case ' ':
-        switch (buf[i]) {
-        CASE_WHITESPACE
-          /* ignore whitespace */
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_SPACE;
-        }
+  /* return offset of invalid byte, or len */
+  return i;
+}
 
-        break;
+/*
+ * Container stack macros.  The stack holds one bit for each level of
+ * nesting: the bit is set for objects and clear for arrays.  Everything
+ * else about the parser state lives in the scalar state (p->state).
+ */
+#define STACK_BIT(d) (1 << ((d) & 7))
 
-      /*****************/
-      /* number states */
-      /*****************/
+#define PUSH_CONTAINER(ps, is_obj) do {             \
+  /* check for stack overflow */                    \
+  if ((ps)->depth >= 8 * (ps)->stack_size)          \
+    return JF_ERR_STACK_OVERFLOW;                   \
+                                                    \
+  /* set or clear bit for this level */             \
+  if (is_obj)                                       \
+    (ps)->stack[(ps)->depth >> 3] |=                \
+      STACK_BIT((ps)->depth);                       \
+  else                                              \
+    (ps)->stack[(ps)->depth >> 3] &=                \
+      ~STACK_BIT((ps)->depth);                      \
+                                                    \
+  /* increment depth */                             \
+  (ps)->depth++;                                    \
+} while (0)
 
-      case 'n':
-        switch (buf[i]) {
-        CASE_DIGIT
-          PUSH_NUM(p, buf[i]);
-          break;
-        case '.':
-          /* handle decimal */
-          POP_STATE(p);
-          PUSH_STATE(p, 'd');
-          PUSH_NUM(p, buf[i]);
-          break;
-        case 'e':
-        case 'E':
-          /* handle exponent */
-          POP_STATE(p);
-          PUSH_STATE(p, 'e');
-          PUSH_NUM(p, 'e');
-          break;
-        CASE_END_NUM
-          /* send number */
-          SEND_FULL(p, JF_TYPE_INTEGER, p->buf, p->buf_len);
-          p->buf_len = 0;
+#define POP_CONTAINER(ps) do {                      \
+  /* check for stack underflow */                   \
+  if (!(ps)->depth)                                 \
+    return JF_ERR_STACK_UNDERFLOW;                  \
+                                                    \
+  /* decriment depth */                             \
+  (ps)->depth--;                                    \
+} while (0)
 
-          /* pop state and retry token */
-          POP_STATE(p);
-          goto retry;
+/* is the innermost container an object? */
+#define IN_OBJECT(ps)                               \
+  ((ps)->stack[((ps)->depth - 1) >> 3] &            \
+   STACK_BIT((ps)->depth - 1))
 
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_DIGIT_E_DOT;
-        }
+/*
+ * END_DOCUMENT() - Send a document boundary and go back to the init
+ * state to look for the next top-level value.
+ */
+#define END_DOCUMENT(ps) do {                       \
+  SEND((ps), JF_TYPE_END_DOCUMENT);                 \
+  (ps)->state = 0;                                  \
+} while (0)
 
-        break;
-      case 'd':
-        switch (buf[i]) {
-        CASE_DIGIT
-          PUSH_NUM(p, buf[i]);
-          break;
-        case 'e':
-        case 'E':
-          /* handle exponent */
-          POP_STATE(p);
-          PUSH_STATE(p, 'e');
-          PUSH_NUM(p, 'e');
-          break;
-        CASE_END_NUM
-          /* send number */
-          SEND_FULL(p, JF_TYPE_FLOAT, p->buf, p->buf_len);
-          p->buf_len = 0;
+/*
+ * END_VALUE() - Set the state which follows a complete value: the
+ * top-level final state (or the next document, if JF_FLAG_NDJSON is
+ * set), a comma in an array, or a comma in an object.  Also ends the
+ * current filter match, if this value was the match.
+ */
+#define END_VALUE(ps) do {                          \
+  if ((ps)->filter && (ps)->filter->emit &&         \
+      (ps)->depth == (ps)->filter->emit_depth)      \
+    (ps)->filter->emit = 0;                         \
+                                                    \
+  if ((ps)->depth)                                  \
+    (ps)->state = IN_OBJECT(ps) ? 'c' : ',';        \
+  else if ((ps)->top == ' ' &&                      \
+           ((ps)->flags & JF_FLAG_NDJSON))          \
+    END_DOCUMENT(ps);                               \
+  else                                              \
+    (ps)->state = (ps)->top;                        \
+} while (0)
 
-          /* pop state and retry token */
-          POP_STATE(p);
-          goto retry;
+/*
+ * scan_skip() - Return the offset of the first double quote or bracket
+ * in buf at or after offset i, or len if there isn't one.  Used to
+ * skip unmatched containers.
+ */
+static size_t
+scan_skip(const uint8_t *buf, size_t i, const size_t len) {
+#ifdef JF_USE_SSE2
+  const __m128i quote = _mm_set1_epi8('"'),
+                lower = _mm_set1_epi8(0x20),
+                bgn   = _mm_set1_epi8('{'),
+                end   = _mm_set1_epi8('}');
+  __m128i v, d;
+  int mask;
+
+  for (; i + 16 <= len; i += 16) {
+    v = _mm_loadu_si128((const __m128i*) (buf + i));
+
+    /* match double quote, and (v | 0x20) == '{' or '}' ('[' or ']') */
+    d = _mm_cmpeq_epi8(v, quote);
+    v = _mm_or_si128(v, lower);
+    d = _mm_or_si128(d, _mm_cmpeq_epi8(v, bgn));
+    d = _mm_or_si128(d, _mm_cmpeq_epi8(v, end));
+
+    if ((mask = _mm_movemask_epi8(d)) != 0)
+      return i + first_bit(mask);
+  }
+#endif /* JF_USE_SSE2 */
+
+  /* scan remaining bytes */
+  for (; i < len; i++) {
+    switch (buf[i]) {
+    case '"':
+    case '{':
+    case '}':
+    case '[':
+    case ']':
+      return i;
+    }
+  }
 
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_DIGIT_E_END_NUM;
-        }
+  return i;
+}
+
+jf_err_t
+jf_path_compile(jf_path_t *path, const char *expr) {
+  const uint8_t *s = (const uint8_t*) expr;
+  jf_path_step_t *step;
+  uint8_t q;
+  size_t i;
+
+  /* path must start at root */
+  if (*s != '$')
+    return JF_ERR_INVALID_PATH;
+
+  for (s++, path->num_steps = 0; *s; path->num_steps++) {
+    /* check path length */
+    if (path->num_steps >= JF_MAX_PATH_STEPS)
+      return JF_ERR_INVALID_PATH;
+
+    step = path->steps + path->num_steps;
+
+    switch (*s) {
+    case '.':
+      s++;
+
+      if (*s == '*') {
+        /* any member */
+        step->type = JF_PATH_STEP_ANY;
+        s++;
+      } else {
+        /* member name runs until the next step */
+        for (i = 0; s[i] && s[i] != '.' && s[i] != '['; i++);
+
+        if (!i)
+          return JF_ERR_INVALID_PATH;
+
+        step->type = JF_PATH_STEP_KEY;
+        step->key = s;
+        step->len = i;
+        s += i;
+      }
+
+      break;
+    case '[':
+      s++;
+
+      if (*s == '*') {
+        /* any element */
+        step->type = JF_PATH_STEP_ANY;
+        s++;
+      } else if (*s == '\'' || *s == '"') {
+        /* quoted member name */
+        for (q = *(s++), i = 0; s[i] && s[i] != q; i++);
+
+        if (!s[i])
+          return JF_ERR_INVALID_PATH;
+
+        step->type = JF_PATH_STEP_KEY;
+        step->key = s;
+        step->len = i;
+        s += i + 1;
+      } else if (IS_DIGIT(*s)) {
+        /* element index */
+        step->type = JF_PATH_STEP_INDEX;
+        for (step->len = 0; IS_DIGIT(*s); s++)
+          step->len = step->len * 10 + (*s - '0');
+      } else {
+        return JF_ERR_INVALID_PATH;
+      }
+
+      if (*(s++) != ']')
+        return JF_ERR_INVALID_PATH;
+
+      break;
+    default:
+      return JF_ERR_INVALID_PATH;
+    }
+  }
+
+  /* return success */
+  return JF_OK;
+}
+
+jf_err_t
+jf_filter_init(jf_filter_t *f, const jf_path_t *paths, size_t num_paths) {
+  if (num_paths > JF_MAX_PATHS)
+    return JF_ERR_INVALID_PATH;
+
+  memset(f, 0, sizeof(jf_filter_t));
+  f->paths = paths;
+  f->num_paths = num_paths;
+
+  /* return success */
+  return JF_OK;
+}
+
+void
+jf_set_filter(jf_t *p, jf_filter_t *f) {
+  p->filter = f;
+
+  if (f) {
+    /* every path is live at the root */
+    f->emit = 0;
+    f->mask[0] = (f->num_paths < 32) ? ((uint32_t) 1 << f->num_paths) - 1 : ~((uint32_t) 0);
+  }
+}
+
+/*
+ * filter_key() - Match the tokens of an object key against the live
+ * filter paths.  Called instead of the callback for keys which are
+ * outside of a matched value.
+ */
+static void
+filter_key(jf_t *p, jf_type_t type, const uint8_t *str, size_t len) {
+  jf_filter_t *f = p->filter;
+  const jf_path_step_t *step;
+  uint32_t m;
+  size_t i;
+
+  switch (type) {
+  case JF_TYPE_BGN_STRING:
+  case JF_TYPE_BGN_KEY:
+    /* start with every live path that can match an object member */
+    f->key_mask = 0;
+    f->key_len = 0;
+
+    for (m = f->mask[p->depth], i = 0; m; m >>= 1, i++) {
+      step = f->paths[i].steps + p->depth - 1;
+      if ((m & 1) && step->type != JF_PATH_STEP_INDEX)
+        f->key_mask |= (uint32_t) 1 << i;
+    }
+
+    break;
+  case JF_TYPE_STRING_FRAGMENT:
+  case JF_TYPE_END_STRING:
+  case JF_TYPE_KEY_FRAGMENT:
+  case JF_TYPE_END_KEY:
+    for (m = f->key_mask, i = 0; m; m >>= 1, i++) {
+      step = f->paths[i].steps + p->depth - 1;
+      if (!(m & 1) || step->type != JF_PATH_STEP_KEY)
+        continue;
+
+      /* drop paths whose member name doesn't match */
+      if ((type == JF_TYPE_END_STRING || type == JF_TYPE_END_KEY) ? (step->len != f->key_len) :
+          (f->key_len + len > step->len || memcmp(step->key + f->key_len, str, len)))
+        f->key_mask &= ~((uint32_t) 1 << i);
+    }
+
+    f->key_len += len;
+
+    break;
+  default:
+    /* never reached */
+    break;
+  }
+}
+
+/*
+ * filter_value() - Match the value starting with the byte c against
+ * the live filter paths.  Starts a match if the value matches a path,
+ * and starts skipping the value if no path can match it or anything
+ * inside it.  Returns 1 if the value is being skipped, and 0 if the
+ * parser should handle the byte as usual.
+ *
+ * Note: Unmatched numbers and literals are short, so they are parsed
+ * as usual and their tokens are discarded.
+ */
+static int
+filter_value(jf_t *p, const uint8_t c) {
+  jf_filter_t *f = p->filter;
+  const jf_path_step_t *step;
+  size_t i, n, d = p->depth;
+  uint32_t m, s = 0;
+
+  /* ignore bytes which don't start a value, and matched values */
+  if (f->emit || !(c == '{' || c == '[' || c == '"' || c == 't' || 
+                   c == 'f' || c == 'n' || c == '-' || IS_DIGIT(c)))
+    return 0;
+
+  if (!d) {
+    /* root value */
+    s = f->mask[0];
+  } else if (IN_OBJECT(p)) {
+    /* object member (key was matched by filter_key()) */
+    s = f->key_mask;
+  } else {
+    /* array element */
+    n = f->index[d]++;
+
+    for (m = f->mask[d], i = 0; m; m >>= 1, i++) {
+      step = f->paths[i].steps + d - 1;
+      if ((m & 1) && (step->type == JF_PATH_STEP_ANY ||
+          (step->type == JF_PATH_STEP_INDEX && step->len == n)))
+        s |= (uint32_t) 1 << i;
+    }
+  }
+
+  /* look for a complete match (lowest path wins) */
+  for (m = s, i = 0; m; m >>= 1, i++) {
+    if ((m & 1) && f->paths[i].num_steps == d) {
+      f->emit = 1;
+      f->emit_depth = d;
+      f->match = i;
+
+      return 0;
+    }
+  }
+
+  /* descend into containers which may contain a match */
+  if (s && (c == '{' || c == '[')) {
+    f->mask[d + 1] = s;
+    f->index[d + 1] = 0;
+
+    return 0;
+  }
+
+  /* skip containers and strings */
+  switch (c) {
+  case '{':
+  case '[':
+    p->skip_depth = 1;
+    p->state = 'k';
+    return 1;
+  case '"':
+    p->skip_depth = 0;
+    p->state = 'q';
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/*
+ * FILTER_VALUE() - Check the current byte against the path filter, if
+ * there is one, and stop handling the byte if the value is skipped.
+ */
+#define FILTER_VALUE(ps)                            \
+  if ((ps)->filter && filter_value((ps), buf[i]))   \
+    break;
+
+/*
+ * Key hash (32-bit FNV-1a) parameters.
+ */
+#define KEY_HASH_INIT   0x811c9dc5
+#define KEY_HASH_PRIME  0x01000193
+
+/*
+ * hash_bytes() - Add the given bytes to a key hash.
+ */
+static uint32_t
+hash_bytes(uint32_t h, const uint8_t *str, size_t len) {
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    h = (h ^ str[i]) * KEY_HASH_PRIME;
+
+  return h;
+}
+
+/*
+ * hash_copy() - Add the given bytes to a key hash, and copy them to
+ * dst in the same pass.
+ */
+static uint32_t
+hash_copy(uint32_t h, uint8_t *dst, const uint8_t *str, size_t len) {
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    dst[i] = str[i];
+    h = (h ^ str[i]) * KEY_HASH_PRIME;
+  }
+
+  return h;
+}
+
+uint32_t
+jf_key_hash(const uint8_t *str, size_t len) {
+  return hash_bytes(KEY_HASH_INIT, str, len);
+}
+
+void
+jf_keys_init(jf_keys_t *k) {
+  memset(k, 0, sizeof(jf_keys_t));
+}
+
+/*
+ * KEY_BGN() - Get the offset of the key with the given ID in the key
+ * table data.
+ */
+#define KEY_BGN(k, id) ((id) ? (k)->ends[(id) - 1] : 0)
+
+/*
+ * find_key() - Find the given key in the hash index of a key table.
+ * Returns the slot of the key, or the empty slot where it belongs if
+ * it isn't in the table.  The index has twice as many slots as the
+ * table has keys, so there is always an empty slot.
+ */
+static uint16_t *
+find_key(jf_keys_t *k, uint32_t hash, const uint8_t *str, size_t len) {
+  uint16_t *slot;
+  size_t i, id;
+
+  for (i = hash; ; i++) {
+    slot = k->slots + (i & (2 * JF_MAX_KEYS - 1));
+    if (!*slot)
+      return slot;
+
+    id = *slot - 1;
+    if (k->hashes[id] == hash && k->ends[id] - KEY_BGN(k, id) == len &&
+        !memcmp(k->data + KEY_BGN(k, id), str, len))
+      return slot;
+  }
+}
+
+/*
+ * intern_key() - Get the ID of the given key, adding it to the key
+ * table if it isn't there yet.  Returns JF_KEY_NONE if the key isn't
+ * in the table and doesn't fit.
+ */
+static uint32_t
+intern_key(jf_keys_t *k, uint32_t hash, const uint8_t *str, size_t len) {
+  uint16_t *slot = find_key(k, hash, str, len);
+  size_t bgn = KEY_BGN(k, k->num_keys);
+
+  /* return existing key */
+  if (*slot)
+    return *slot - 1;
+
+  /* check for room */
+  if (k->num_keys >= JF_MAX_KEYS || len > JF_MAX_KEY_LEN || bgn + len > JF_MAX_KEYS_LEN)
+    return JF_KEY_NONE;
+
+  /* add key */
+  memcpy(k->data + bgn, str, len);
+  k->hashes[k->num_keys] = hash;
+  k->ends[k->num_keys] = bgn + len;
+  *slot = (uint16_t) ++k->num_keys;
+
+  return k->num_keys - 1;
+}
+
+jf_err_t
+jf_keys_add(jf_keys_t *k, const uint8_t *str, size_t len, uint32_t *id) {
+  uint32_t v = intern_key(k, jf_key_hash(str, len), str, len);
+
+  if (v == JF_KEY_NONE)
+    return JF_ERR_STORAGE_TOO_SMALL;
+
+  /* save key ID */
+  if (id)
+    *id = v;
+
+  /* return success */
+  return JF_OK;
+}
+
+const uint8_t *
+jf_keys_get(const jf_keys_t *k, uint32_t id, size_t *len) {
+  if (id >= k->num_keys)
+    return NULL;
+
+  *len = k->ends[id] - KEY_BGN(k, id);
+  return k->data + KEY_BGN(k, id);
+}
+
+void
+jf_set_keys(jf_t *p, jf_keys_t *k, jf_key_buf_t *kb) {
+  p->keys = k;
+  p->key_buf = kb;
+}
+
+/*
+ * mix() - Mix the bits of a key hash (the MurmurHash3 finalizer).  Used
+ * to get key map buckets and slots.
+ */
+static uint32_t
+mix(uint32_t h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+
+  return h;
+}
+
+/*
+ * KEYMAP_BUCKET() and KEYMAP_SLOT() - Get the bucket of a key hash, and
+ * the slot of a key hash with the given bucket displacement.
+ */
+#define KEYMAP_BUCKET(km, h)                        \
+  ((size_t) (((uint64_t) mix(h) *                   \
+    (km)->num_buckets) >> 32))
+
+#define KEYMAP_SLOT(km, h, d)                       \
+  ((size_t) (((uint64_t) mix(                       \
+    (h) + ((uint32_t) (d) + 1) * 0x9e3779b9         \
+  ) * (km)->num_keys) >> 32))
+
+/*
+ * Number of key map buckets for the given number of keys, and largest
+ * bucket displacement.
+ */
+#define KEYMAP_NUM_BUCKETS(n) (((n) + 1) / 2)
+#define KEYMAP_MAX_DISP       0xffff
+
+/*
+ * place_bucket() - Find a displacement which puts every key in the
+ * given bucket in a free slot, and put them there.  Returns 0 if there
+ * is no such displacement.
+ */
+static int
+place_bucket(jf_keymap_t *km, uint8_t *used, const uint32_t *hashes, const uint16_t *members, size_t num_members, size_t b) {
+  size_t d, i, j, slots[JF_MAX_KEYS];
+
+  for (d = 0; d <= KEYMAP_MAX_DISP; d++) {
+    /* check for free slots which aren't shared within the bucket */
+    for (i = 0; i < num_members; i++) {
+      slots[i] = KEYMAP_SLOT(km, hashes[members[i]], d);
+      if (used[slots[i]])
+        break;
+
+      for (j = 0; j < i && slots[j] != slots[i]; j++);
+      if (j < i)
+        break;
+    }
+
+    if (i < num_members)
+      continue;
+
+    /* save displacement and mark slots as used */
+    km->disps[b] = (uint16_t) d;
+    for (i = 0; i < num_members; i++)
+      used[slots[i]] = 1;
+
+    return 1;
+  }
+
+  /* no displacement found */
+  return 0;
+}
+
+jf_err_t
+jf_keymap_init(jf_keymap_t *km, const char * const *keys, size_t num_keys) {
+  uint32_t hashes[JF_MAX_KEYS];
+  uint16_t members[JF_MAX_KEYS], counts[JF_MAX_KEYS];
+  uint8_t used[JF_MAX_KEYS];
+  size_t i, j, b, n, size, lens[JF_MAX_KEYS];
+
+  memset(km, 0, sizeof(jf_keymap_t));
+
+  if (num_keys > JF_MAX_KEYS)
+    return JF_ERR_INVALID_KEYMAP;
+
+  /* hash keys */
+  for (i = 0; i < num_keys; i++) {
+    lens[i] = strlen(keys[i]);
+    if (lens[i] > JF_MAX_KEY_LEN)
+      return JF_ERR_INVALID_KEYMAP;
+
+    hashes[i] = jf_key_hash((const uint8_t*) keys[i], lens[i]);
+
+    /* keys with the same hash can't be told apart */
+    for (j = 0; j < i; j++)
+      if (hashes[j] == hashes[i])
+        return JF_ERR_INVALID_KEYMAP;
+  }
+
+  km->num_keys = num_keys;
+  km->num_buckets = KEYMAP_NUM_BUCKETS(num_keys);
+
+  /* count keys in each bucket */
+  memset(counts, 0, sizeof(counts));
+  for (i = 0; i < num_keys; i++)
+    counts[KEYMAP_BUCKET(km, hashes[i])]++;
+
+  /* place buckets, largest first, so the hardest ones get the most free slots */
+  memset(used, 0, sizeof(used));
+  for (size = num_keys; size > 0; size--) {
+    for (b = 0; b < km->num_buckets; b++) {
+      if (counts[b] != size)
+        continue;
+
+      /* get keys in bucket */
+      for (n = 0, i = 0; i < num_keys; i++)
+        if (KEYMAP_BUCKET(km, hashes[i]) == b)
+          members[n++] = (uint16_t) i;
+
+      if (!place_bucket(km, used, hashes, members, n, b))
+        return JF_ERR_INVALID_KEYMAP;
+    }
+  }
+
+  /* save keys to their slots */
+  for (i = 0; i < num_keys; i++) {
+    j = KEYMAP_SLOT(km, hashes[i], km->disps[KEYMAP_BUCKET(km, hashes[i])]);
+    km->hashes[j] = hashes[i];
+    km->ids[j] = (uint16_t) i;
+    km->keys[j] = (const uint8_t*) keys[i];
+    km->lens[j] = lens[i];
+  }
+
+  /* return success */
+  return JF_OK;
+}
+
+/*
+ * keymap_find() - Get the index of a key with the given hash in a key
+ * map, or JF_KEY_NONE if it isn't there.
+ */
+static uint32_t
+keymap_find(const jf_keymap_t *km, uint32_t hash, const uint8_t *str, size_t len) {
+  size_t i;
+
+  if (!km->num_keys)
+    return JF_KEY_NONE;
+
+  /* check the only slot the key can be in */
+  i = KEYMAP_SLOT(km, hash, km->disps[KEYMAP_BUCKET(km, hash)]);
+  if (km->hashes[i] != hash || km->lens[i] != len || memcmp(km->keys[i], str, len))
+    return JF_KEY_NONE;
+
+  return km->ids[i];
+}
+
+uint32_t
+jf_keymap_find(const jf_keymap_t *km, const uint8_t *str, size_t len) {
+  return keymap_find(km, jf_key_hash(str, len), str, len);
+}
+
+void
+jf_set_keymap(jf_t *p, const jf_keymap_t *km, jf_key_buf_t *kb) {
+  p->keymap = km;
+  p->key_buf = kb;
+}
+
+/*
+ * key_token() - Hash the tokens of an object key, look the key up in
+ * the key map or key table (if there is one), and get the key token
+ * type to send instead of the string token type.  Called for object
+ * keys with JF_FLAG_KEY_TOKENS set.
+ */
+static jf_type_t
+key_token(jf_t *p, jf_type_t type, const uint8_t *str, size_t len) {
+  jf_key_buf_t *kb = p->key_buf;
+
+  switch (type) {
+  case JF_TYPE_BGN_STRING:
+    p->key_hash = KEY_HASH_INIT;
+    p->key_id = JF_KEY_NONE;
+    if (kb)
+      kb->len = 0;
+
+    return JF_TYPE_BGN_KEY;
+  case JF_TYPE_STRING_FRAGMENT:
+    if (!kb) {
+      /* nothing to look the key up in */
+      p->key_hash = hash_bytes(p->key_hash, str, len);
+      return JF_TYPE_KEY_FRAGMENT;
+    }
+
+    /* 
+     * collect key for lookup while hashing it (even without a key map
+     * or key table, since one can be attached before the key ends);
+     * keep counting past the end of the buffer, so long keys are never
+     * looked up
+     */
+    if (kb->len + len <= JF_MAX_KEY_LEN)
+      p->key_hash = hash_copy(p->key_hash, kb->buf + kb->len, str, len);
+    else
+      p->key_hash = hash_bytes(p->key_hash, str, len);
+    kb->len += len;
+
+    return JF_TYPE_KEY_FRAGMENT;
+  case JF_TYPE_END_STRING:
+    if (kb && kb->len <= JF_MAX_KEY_LEN) {
+      if (p->keymap)
+        p->key_id = keymap_find(p->keymap, p->key_hash, kb->buf, kb->len);
+      else if (p->keys)
+        p->key_id = intern_key(p->keys, p->key_hash, kb->buf, kb->len);
+    }
+
+    return JF_TYPE_END_KEY;
+  default:
+    /* never reached */
+    return type;
+  }
+}
+
+/*
+ * batch_token() - Append a token to the current batch.  Values in the 
+ * parser buffer are copied to the batch data, because the parser
+ * buffer is reused; all other values point into the input buffer.
+ *
+ * Note: jf_parse() stops before the batch can run out of room, so
+ * there's no need to check for space here.
+ */
+static void
+batch_token(jf_t *p, jf_type_t type, const uint8_t *str, size_t len) {
+  jf_batch_t *b = p->batch;
+  jf_token_t *t = b->tokens + b->num_tokens;
+
+  t->type = type;
+  t->ofs = p->num_bytes;
+  t->len = len;
+
+  /* save converted number or key hash */
+  if (type == JF_TYPE_INTEGER || type == JF_TYPE_FLOAT) {
+    t->num = p->num;
+  } else if (type == JF_TYPE_END_KEY) {
+    t->key_hash = p->key_hash;
+    t->key_id = p->key_id;
+  }
+
+  if (len > 0 && str == p->buf) {
+    /* copy value out of parser buffer */
+    memcpy(b->data + b->data_len, str, len);
+    t->val = b->data + b->data_len;
+    b->data_len += len;
+  } else {
+    t->val = str;
+  }
+
+  b->num_tokens++;
+}
+
+/*
+ * BATCH_FULL() - Is the current batch too full to be sure that the 
+ * next input byte won't overflow it?  One byte can copy a full parser
+ * buffer and then one more character (see JF_BATCH_DATA_SLACK).
+ */
+#define BATCH_FULL(ps)                              \
+  ((ps)->batch->num_tokens + JF_MIN_BATCH_TOKENS >  \
+     (ps)->batch->max_tokens ||                     \
+   (ps)->batch->data_len + (ps)->buf_size +         \
+     JF_BATCH_DATA_SLACK > (ps)->batch->data_size)
+
+/*
+ * skip_value() - Handle an error returned by the parser callback for a
+ * token of the given type.  If the error is JF_SKIP, then start
+ * skipping the rest of the value and return JF_OK; otherwise return
+ * the error.
+ *
+ * Note: The parser sets the state which follows a token before sending
+ * it, so this state can be replaced here.
+ */
+static jf_err_t
+skip_value(jf_t *p, jf_type_t type, jf_err_t err) {
+  if (err != JF_SKIP)
+    return err;
+
+  switch (type) {
+  case JF_TYPE_BGN_OBJECT:
+  case JF_TYPE_BGN_ARRAY:
+    /* skip rest of container (which was already pushed) */
+    p->depth--;
+    p->skip_depth = 1;
+    p->state = 'k';
+
+    break;
+  case JF_TYPE_BGN_STRING:
+    /* skip rest of string (but not keys) */
+    if (!p->key) {
+      p->skip_depth = 0;
+      p->state = 'q';
+    }
+
+    break;
+  case JF_TYPE_END_KEY:
+  case JF_TYPE_END_STRING:
+    /* skip colon and member value */
+    if (p->key)
+      p->state = 'K';
+
+    break;
+  default:
+    /* nothing to skip */
+    break;
+  }
+
+  /* return success */
+  return JF_OK;
+}
+
+#define SEND_FULL(ps, type, str, str_len) do {      \
+  if ((ps)->filter && !(ps)->filter->emit &&        \
+      (type) != JF_TYPE_END_DOCUMENT) {             \
+    /* outside of filter match; only match keys */  \
+    if ((ps)->key)                                  \
+      filter_key((ps), (type), (str), (str_len));   \
+  } else if ((ps)->batch) {                         \
+    batch_token((ps), (type), (str), (str_len));    \
+  } else if ((ps)->cb) {                            \
+    err = (ps)->cb((ps), (type), (str), (str_len)); \
+                                                    \
+    if (err != JF_OK && (err = skip_value(          \
+          (ps), (type), err)) != JF_OK)             \
+      return err;                                   \
+  }                                                 \
+} while (0)
+
+#define SEND(ps, type) SEND_FULL(ps, type, 0, 0)
+
+/*
+ * SEND_STRING() - Send a string token, or the matching key token if
+ * the string is an object key and JF_FLAG_KEY_TOKENS is set.
+ */
+#define SEND_STRING(ps, type, str, str_len) do {    \
+  if ((ps)->key &&                                  \
+      ((ps)->flags & JF_FLAG_KEY_TOKENS)) {         \
+    jf_type_t key_type_ = key_token(                \
+      (ps), (type), (str), (str_len)                \
+    );                                              \
+                                                    \
+    SEND_FULL((ps), key_type_, (str), (str_len));   \
+  } else {                                          \
+    SEND_FULL((ps), (type), (str), (str_len));      \
+  }                                                 \
+} while (0)
+
+#define SEND_STRING_FRAGMENT(ps) do {               \
+  if ((ps)->buf_len > 0) {                          \
+    SEND_STRING(                                    \
+      (ps), JF_TYPE_STRING_FRAGMENT,                \
+      (ps)->buf, (ps)->buf_len                      \
+    );                                              \
+                                                    \
+    (ps)->buf_len = 0;                              \
+  }                                                 \
+} while (0)
+
+#define PUSH_CHAR(ps, c) do {                       \
+  if ((ps)->buf_len + 1 >= (ps)->buf_size)          \
+    SEND_STRING_FRAGMENT(ps);                       \
+  (ps)->buf[(ps)->buf_len++] = (c);                 \
+} while (0)
+
+/*
+ * FROM_HEX() - Get the value of a hex digit (0-9, a-f, or A-F) without
+ * branching: letters have bit 6 set, and their low nibble is 1 to 6.
+ */
+#define FROM_HEX(c) (((c) & 0xf) + 9 * ((c) >> 6))
+
+/*
+ * IS_HIGH_SURROGATE() and IS_LOW_SURROGATE() - Is the given UTF-16
+ * code unit the first or second half of a surrogate pair?
+ */
+#define IS_HIGH_SURROGATE(v) ((v) >= 0xd800 && (v) <= 0xdbff)
+#define IS_LOW_SURROGATE(v) ((v) >= 0xdc00 && (v) <= 0xdfff)
+
+/*
+ * encode_utf8() - Write the given code point to dst as UTF-8.  Returns
+ * the number of bytes written (at most 4).
+ */
+static size_t
+encode_utf8(uint8_t *dst, const uint32_t v) {
+  if (v < 0x80) {
+    dst[0] = (uint8_t) v;
+    return 1;
+  } else if (v < 0x800) {
+    dst[0] = 0xc0 | (v >> 6);
+    dst[1] = 0x80 | (v & 0x3f);
+    return 2;
+  } else if (v < 0x10000) {
+    dst[0] = 0xe0 | (v >> 12);
+    dst[1] = 0x80 | ((v >> 6) & 0x3f);
+    dst[2] = 0x80 | (v & 0x3f);
+    return 3;
+  } else {
+    dst[0] = 0xf0 | (v >> 18);
+    dst[1] = 0x80 | ((v >> 12) & 0x3f);
+    dst[2] = 0x80 | ((v >> 6) & 0x3f);
+    dst[3] = 0x80 | (v & 0x3f);
+    return 4;
+  }
+}
+
+/*
+ * PUSH_CODEPOINT() - Append a code point to the buffer as UTF-8.  The
+ * buffer is only flushed if the whole character doesn't fit, so
+ * characters are never split between string fragments.
+ */
+#define PUSH_CODEPOINT(ps, v) do {                  \
+  if ((ps)->buf_len + 4 >= (ps)->buf_size)          \
+    SEND_STRING_FRAGMENT(ps);                       \
+  (ps)->buf_len += encode_utf8(                     \
+    (ps)->buf + (ps)->buf_len, (v)                  \
+  );                                                \
+} while (0)
+
+/*
+ * UNPAIRED_SURROGATE() - Handle a high surrogate escape which isn't
+ * followed by a low surrogate escape.  This is an error, unless
+ * JF_FLAG_IGNORE_RFC3629 is set, in which case the surrogate is
+ * appended as-is (as a 3-byte sequence).
+ */
+#define UNPAIRED_SURROGATE(ps) do {                 \
+  if (!((ps)->flags & JF_FLAG_IGNORE_RFC3629))      \
+    return JF_ERR_INVALID_TOKEN_UNPAIRED_SURROGATE; \
+                                                    \
+  PUSH_CODEPOINT((ps), (ps)->surrogate);            \
+  (ps)->surrogate = 0;                              \
+} while (0)
+
+/*
+ * decode_escape() - Decode the \u escape in p->hex and append it to the
+ * buffer as UTF-8.  A high surrogate is held in p->surrogate until the
+ * next escape (which may be in the next call to jf_parse()), and
+ * combined with it if it's a low surrogate.
+ */
+static jf_err_t
+decode_escape(jf_t *p) {
+  uint32_t v = p->hex;
+  jf_err_t err;
+
+  if (p->surrogate) {
+    if (IS_LOW_SURROGATE(v)) {
+      /* combine surrogate pair */
+      v = 0x10000 + ((uint32_t) (p->surrogate - 0xd800) << 10) + (v - 0xdc00);
+      p->surrogate = 0;
+      PUSH_CODEPOINT(p, v);
+
+      return JF_OK;
+    }
+
+    UNPAIRED_SURROGATE(p);
+  }
+
+  if (IS_HIGH_SURROGATE(v)) {
+    /* wait for low surrogate */
+    p->surrogate = v;
+  } else if (IS_LOW_SURROGATE(v) && !(p->flags & JF_FLAG_IGNORE_RFC3629)) {
+    /* low surrogate without high surrogate */
+    return JF_ERR_INVALID_TOKEN_UNPAIRED_SURROGATE;
+  } else {
+    PUSH_CODEPOINT(p, v);
+  }
+
+  /* return success */
+  return JF_OK;
+}
+
+/*
+ * PUSH_RUN() - Append a run of string characters to the buffer,
+ * sending string fragments as the buffer fills up.  Fragments are
+ * split at the same points as they would be with PUSH_CHAR().
+ */
+#define PUSH_RUN(ps, str, str_len) do {             \
+  const uint8_t *run_ = (str);                      \
+  size_t run_len_ = (str_len), n_;                  \
+                                                    \
+  while (run_len_ > 0) {                            \
+    if ((ps)->buf_len + 1 >= (ps)->buf_size)        \
+      SEND_STRING_FRAGMENT(ps);                     \
+                                                    \
+    /* copy as much of the run as will fit */       \
+    n_ = (ps)->buf_size - 1 - (ps)->buf_len;        \
+    if (n_ > run_len_)                              \
+      n_ = run_len_;                                \
+                                                    \
+    memcpy((ps)->buf + (ps)->buf_len, run_, n_);    \
+    (ps)->buf_len += n_;                            \
+    run_ += n_;                                     \
+    run_len_ -= n_;                                 \
+  }                                                 \
+} while (0)
+
+/*
+ * Parts of a number, used by accumulate_digits().
+ */
+#define NUM_INT   0 /* integer part */
+#define NUM_FRAC  1 /* fractional part */
+#define NUM_EXP   2 /* exponent */
+
+/*
+ * Maximum number of significant digits accumulated in the mantissa;
+ * 19 decimal digits always fit in 64 bits.
+ */
+#define NUM_MAX_DIGITS 19
+
+/*
+ * accumulate_digits() - Add a run of digits to the binary value of the
+ * current number.  Only used if JF_FLAG_CONVERT_NUMBERS is set.
+ */
+static void
+accumulate_digits(jf_t *p, const uint8_t *str, size_t len, const int part) {
+  size_t i;
+  uint8_t d;
+
+  for (i = 0; i < len; i++) {
+    d = str[i] - '0';
+
+    if (part == NUM_EXP) {
+      /* clamp huge exponents; the result is 0 or infinity anyway */
+      if (p->num_exp < 100000)
+        p->num_exp = p->num_exp * 10 + d;
+    } else if (p->num_digits < NUM_MAX_DIGITS) {
+      p->num_mant = p->num_mant * 10 + d;
+
+      /* don't count leading zeros as significant digits */
+      if (p->num_mant)
+        p->num_digits++;
+
+      /* each fractional digit scales the mantissa down by 10 */
+      if (part == NUM_FRAC)
+        p->num_exp10--;
+    } else {
+      /* mantissa is full; drop digit */
+      p->num_trunc = 1;
+
+      /* each dropped integer digit scales the mantissa up by 10 */
+      if (part == NUM_INT)
+        p->num_exp10++;
+    }
+  }
+}
+
+/*
+ * Powers of ten which can be represented exactly as doubles.
+ */
+static const double
+exact_pow10[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+  1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+  1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ * parse_double() - Convert null-terminated number text with strtod().
+ *
+ * Note: strtod() expects the decimal point of the current locale (see
+ * LC_NUMERIC), but JSON always uses '.', so if strtod() stops at the
+ * '.', then swap in the locale decimal point and try again.  The
+ * decimal point is found with sprintf() (like the writer does), which
+ * unlike localeconv() is safe to call from several threads.  Locales
+ * with multibyte decimal points aren't supported.
+ */
+static double
+parse_double(char *str) {
+  char tmp[32], *end;
+  double d = strtod(str, &end);
+
+  if (*end == '.') {
+    sprintf(tmp, "%.1f", 0.5);
+
+    if (tmp[1] != '.' && tmp[2] == '5') {
+      *end = tmp[1];
+      d = strtod(str, NULL);
+      *end = '.';
+    }
+  }
+
+  return d;
+}
+
+/*
+ * convert_number() - Populate p->num with the binary value of the
+ * current number.  Only used if JF_FLAG_CONVERT_NUMBERS is set.
+ *
+ * Note: Numbers with at most 15 significant digits and a small 
+ * exponent (which covers most real-world data) are converted exactly
+ * with a single floating point multiply or divide.  Anything else is
+ * converted from the number text with strtod() (see parse_double()).
+ */
+static void
+convert_number(jf_t *p, const jf_type_t type) {
+  jf_num_t *n = &(p->num);
+  int32_t e;
+
+  n->flags = 0;
+  n->i = 0;
+
+  /* integer value */
+  if (type == JF_TYPE_INTEGER) {
+    if (p->num_trunc || p->num_mant > (uint64_t) INT64_MAX + p->num_neg) {
+      /* saturate on overflow */
+      n->i = p->num_neg ? INT64_MIN : INT64_MAX;
+      n->flags |= JF_NUM_OVERFLOW;
+    } else if (p->num_neg) {
+      n->i = -(int64_t) (p->num_mant - 1) - 1;
+    } else {
+      n->i = (int64_t) p->num_mant;
+    }
+  }
+
+  /* get decimal exponent */
+  e = p->num_exp10 + (p->num_exp_neg ? -p->num_exp : p->num_exp);
+
+  /* floating point value */
+  if (!p->num_trunc && p->num_mant <= ((uint64_t) 1 << 53) && e >= -22 && e <= 22) {
+    /* fast path: mantissa and power of ten are both exact */
+    n->d = (double) p->num_mant;
+    n->d = (e < 0) ? n->d / exact_pow10[-e] : n->d * exact_pow10[e];
+
+    if (p->num_neg)
+      n->d = -n->d;
+  } else {
+    /* slow path: null-terminate number text and use strtod() */
+    p->buf[p->buf_len] = '\0';
+    n->d = parse_double((char*) p->buf);
+
+    if (n->d == HUGE_VAL || n->d == -HUGE_VAL)
+      n->flags |= JF_NUM_OVERFLOW;
+  }
+}
+
+#define PUSH_NUM(ps, c) do {                        \
+  if ((ps)->buf_len + 1 >= (ps)->buf_size)          \
+    return JF_ERR_NUMBER_TOO_BIG;                   \
+  (ps)->buf[(ps)->buf_len++] = (c);                 \
+} while (0)
+
+/*
+ * PUSH_DIGITS() - Copy the run of digits starting at buf[i] to the
+ * number buffer in one step, and accumulate their value if number
+ * conversion is enabled.
+ */
+#define PUSH_DIGITS(ps, part) do {                  \
+  /* find end of digit run */                       \
+  for (j = i + 1; j < buf_len && IS_DIGIT(buf[j]); j++); \
+                                                    \
+  /* check for overflow at the same byte as PUSH_NUM() */ \
+  if ((ps)->buf_len + (j - i) >= (ps)->buf_size) {  \
+    (ps)->num_bytes += (ps)->buf_size - 1 - (ps)->buf_len; \
+    return JF_ERR_NUMBER_TOO_BIG;                   \
+  }                                                 \
+                                                    \
+  if ((ps)->flags & JF_FLAG_CONVERT_NUMBERS)        \
+    accumulate_digits((ps), buf + i, j - i, (part)); \
+                                                    \
+  memcpy((ps)->buf + (ps)->buf_len, buf + i, j - i); \
+  (ps)->buf_len += j - i;                           \
+                                                    \
+  /* resume at the byte that ended the run */       \
+  i = j - 1;                                        \
+} while (0)
+
+/*
+ * SEND_NUMBER() - Send the number in the buffer (converting it first,
+ * if number conversion is enabled), then clear the buffer.
+ */
+#define SEND_NUMBER(ps, type) do {                  \
+  if ((ps)->flags & JF_FLAG_CONVERT_NUMBERS)        \
+    convert_number((ps), (type));                   \
+                                                    \
+  SEND_FULL((ps), (type), (ps)->buf, (ps)->buf_len); \
+  (ps)->buf_len = 0;                                \
+} while (0)
+
+/*
+ * BGN_NUMBER() - Reset the number accumulator.
+ */
+#define BGN_NUMBER(ps) do {                         \
+  (ps)->num_mant = 0;                               \
+  (ps)->num_exp = (ps)->num_exp10 = 0;              \
+  (ps)->num_digits = (ps)->num_trunc = 0;           \
+  (ps)->num_neg = (ps)->num_exp_neg = 0;            \
+} while (0)
+
+#define CASE_WHITESPACE                             \
+  case ' ':                                         \
+  case '\b':                                        \
+  case '\f':                                        \
+  case '\t':                                        \
+  case '\n':                                        \
+  case '\r':                                        \
+  case '\v':                
+
+/*
+ * SKIP_WHITESPACE() - Skip the rest of the whitespace run at buf[i] in
+ * one step instead of dispatching on every byte.  The enclosing loop
+ * in jf_parse() increments i past the last whitespace byte.
+ */
+#define SKIP_WHITESPACE() do {                      \
+  i = scan_space(buf, i + 1, buf_len) - 1;          \
+} while (0)
+
+#define CASE_DIGIT                                  \
+  case '0':                                         \
+  case '1':                                         \
+  case '2':                                         \
+  case '3':                                         \
+  case '4':                                         \
+  case '5':                                         \
+  case '6':                                         \
+  case '7':                                         \
+  case '8':                                         \
+  case '9':                 
+
+#define CASE_HEX                                    \
+  CASE_DIGIT                                        \
+  case 'a':                                         \
+  case 'b':                                         \
+  case 'c':                                         \
+  case 'd':                                         \
+  case 'e':                                         \
+  case 'f':                                         \
+  case 'A':                                         \
+  case 'B':                                         \
+  case 'C':                                         \
+  case 'D':                                         \
+  case 'E':                                         \
+  case 'F':
+
+#define CASE_END_NUM                                \
+  CASE_WHITESPACE                                   \
+  case ',':                                         \
+  case ']':                                         \
+  case '}':                                         \
+  case ')':
+
+#define ACCEPT_EXPR(ps, buffer)                     \
+  CASE_WHITESPACE                                   \
+    /* skip whitespace */                           \
+    SKIP_WHITESPACE();                              \
+    break;                                          \
+  case '{':                                         \
+    PUSH_CONTAINER((ps), 1);                        \
+    (ps)->state = 'o';                              \
+    SEND((ps), JF_TYPE_BGN_OBJECT);                 \
+                                                    \
+    break;                                          \
+  case '[':                                         \
+    PUSH_CONTAINER((ps), 0);                        \
+    (ps)->state = 'a';                              \
+    SEND((ps), JF_TYPE_BGN_ARRAY);                  \
+                                                    \
+    break;                                          \
+  case '"':                                         \
+    (ps)->state = 's';                              \
+    SEND((ps), JF_TYPE_BGN_STRING);                 \
+                                                    \
+    break;                                          \
+  case 't':                                         \
+    (ps)->state = 'T';                              \
+    break;                                          \
+  case 'f':                                         \
+    (ps)->state = 'F';                              \
+    break;                                          \
+  case 'n':                                         \
+    (ps)->state = 'N';                              \
+    break;                                          \
+  CASE_DIGIT                                        \
+  case '-':                                         \
+    (ps)->state = 'n';                              \
+    (ps)->buf_len = 0;                              \
+    BGN_NUMBER(ps);                                 \
+                                                    \
+    /* let the number state handle digits */        \
+    if ((buffer)[i] != '-')                         \
+      goto retry;                                   \
+                                                    \
+    (ps)->num_neg = 1;                              \
+    PUSH_NUM((ps), '-');                            \
+                                                    \
+    break;
+
+
+/*
+ * parse() - Parse given JSON data with parser.  Stops early if the
+ * parser has a batch and the batch is full.  The number of bytes
+ * consumed is saved to num_read.
+ */
+static jf_err_t
+parse(jf_t *p, const uint8_t *buf, const size_t buf_len, size_t *num_read) {
+  size_t i, j, k, base;
+  jf_err_t err;
+
+  /* save initial byte count */
+  base = p->num_bytes;
+
+  /* iterate over each character in buffer */
+  for (i = 0; i < buf_len; i++) {
+    /* add to byte count */
+    p->num_bytes = base + i;
+
+    /* stop if the batch is full */
+    if (p->batch && BATCH_FULL(p))
+      break;
+
+retry:
+    switch (p->state) {
+
+    /**************/
+    /* init state */
+    /**************/
+
+    case 0:
+      /* no state; look for opening parenthesis */
+      p->top = ' ';
+      FILTER_VALUE(p);
+
+      switch (buf[i]) {
+      ACCEPT_EXPR(p, buf)
+      case '(':
+        p->state = 'i';
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_PAREN_SPACE_EXPR;
+      }
+
+      break;
+    case 'i':
+      p->top = 'f';
+      FILTER_VALUE(p);
+
+      switch (buf[i]) {
+      ACCEPT_EXPR(p, buf)
+      case ')':
+        if (p->flags & JF_FLAG_NDJSON)
+          END_DOCUMENT(p);
+        else
+          p->state = ' ';
+
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_PAREN_EXPR;
+      }
+
+      break;
+
+    /**************/
+    /* fini state */
+    /**************/
+
+    case 'f':
+      switch (buf[i]) {
+      CASE_WHITESPACE
+        /* skip whitespace */
+        SKIP_WHITESPACE();
+        break;
+      case ')':
+        if (p->flags & JF_FLAG_NDJSON)
+          END_DOCUMENT(p);
+        else
+          p->state = ' ';
+
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CL_PAREN_SPACE;
+      }
+
+      break;
+
+    case ' ':
+      switch (buf[i]) {
+      CASE_WHITESPACE
+        /* skip whitespace */
+        SKIP_WHITESPACE();
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_SPACE;
+      }
+
+      break;
+
+    /*****************/
+    /* number states */
+    /*****************/
+
+    case 'n':
+      switch (buf[i]) {
+      CASE_DIGIT
+        PUSH_DIGITS(p, NUM_INT);
+        break;
+      case '.':
+        /* handle decimal */
+        p->state = 'd';
+        PUSH_NUM(p, buf[i]);
+        break;
+      case 'e':
+      case 'E':
+        /* handle exponent */
+        p->state = 'e';
+        PUSH_NUM(p, 'e');
+        break;
+      CASE_END_NUM
+        /* send number */
+        SEND_NUMBER(p, JF_TYPE_INTEGER);
+
+        /* end value and retry token */
+        END_VALUE(p);
+        goto retry;
+
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_DIGIT_E_DOT;
+      }
+
+      break;
+    case 'd':
+      switch (buf[i]) {
+      CASE_DIGIT
+        PUSH_DIGITS(p, NUM_FRAC);
+        break;
+      case 'e':
+      case 'E':
+        /* handle exponent */
+        p->state = 'e';
+        PUSH_NUM(p, 'e');
+        break;
+      CASE_END_NUM
+        /* send number */
+        SEND_NUMBER(p, JF_TYPE_FLOAT);
+
+        /* end value and retry token */
+        END_VALUE(p);
+        goto retry;
+
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_DIGIT_E_END_NUM;
+      }
+
+      break;
+    case 'e':
+      switch (buf[i]) {
+      CASE_DIGIT
+        /* let the exponent state handle digits */
+        p->state = 'g';
+        goto retry;
+
+        break;
+      case '-':
+        p->num_exp_neg = 1;
+        /* fall through */
+      case '+':
+        p->state = 'g';
+        PUSH_NUM(p, buf[i]);
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_DIGIT_PLUS_MINUS;
+      }
+
+      break;
+    case 'g':
+      switch (buf[i]) {
+      CASE_DIGIT
+        PUSH_DIGITS(p, NUM_EXP);
+        break;
+      CASE_END_NUM
+        /* send number */
+        SEND_NUMBER(p, JF_TYPE_FLOAT);
+
+        /* end value and retry token */
+        END_VALUE(p);
+        goto retry;
+
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_DIGIT_END_NUM;
+      }
+
+      break;
+
+    /*****************/
+    /* "null" states */
+    /*****************/
+
+    case 'N':
+      if (buf[i] == 'u') {
+        p->state = 'U';
+      } else {
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_U;
+      }
+
+      break;
+    case 'U':
+      if (buf[i] == 'l') {
+        p->state = 'L';
+      } else {
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_L;
+      }
+
+      break;
+    case 'L':
+      if (buf[i] == 'l') {
+        SEND(p, JF_TYPE_NULL);
+        END_VALUE(p);
+      } else {
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_L;
+      }
+
+      break;
+
+    /*****************/
+    /* "true" states */
+    /*****************/
+
+    case 'T':
+      if (buf[i] == 'r') {
+        p->state = 'R';
+      } else {
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_R;
+      }
+
+      break;
+    case 'R':
+      if (buf[i] == 'u') {
+        p->state = 'W';
+      } else {
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_U;
+      }
+
+      break;
+    case 'W':
+      if (buf[i] == 'e') {
+        SEND(p, JF_TYPE_TRUE);
+        END_VALUE(p);
+      } else {
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_E;
+      }
+
+      break;
+
+    /******************/
+    /* "false" states */
+    /******************/
+
+    case 'F':
+      if (buf[i] == 'a') {
+        p->state = 'A';
+      } else {
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_A;
+      }
+
+      break;
+    case 'A':
+      if (buf[i] == 'l') {
+        p->state = 'M';
+      } else {
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_L;
+      }
+
+      break;
+    case 'M':
+      if (buf[i] == 's') {
+        p->state = 'S';
+      } else {
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_S;
+      }
+
+      break;
+    case 'S':
+      if (buf[i] == 'e') {
+        SEND(p, JF_TYPE_FALSE);
+        END_VALUE(p);
+      } else {
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_E;
+      }
+
+      break;
+
+    /***************/
+    /* array state */
+    /***************/
+
+    case 'a':
+      FILTER_VALUE(p);
+
+      switch (buf[i]) {
+      ACCEPT_EXPR(p, buf)
+      case ']':
+        SEND(p, JF_TYPE_END_ARRAY);
+        
+        POP_CONTAINER(p);
+        END_VALUE(p);
+
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CL_BRACKET_EXPR;
+      }
+
+      break;
+    case ',':
+      switch (buf[i]) {
+      CASE_WHITESPACE
+        /* skip whitespace */
+        SKIP_WHITESPACE();
+        break;
+      case ',':
+        p->state = 'a';
+        break;
+      case ']':
+        p->state = 'a';
+        goto retry;
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CL_BRACKET_COMMA_SPACE;
+      }
+
+      break;
+
+    /****************/
+    /* object state */
+    /****************/
+
+    case 'o':
+      switch (buf[i]) {
+      CASE_WHITESPACE
+        /* skip whitespace */
+        SKIP_WHITESPACE();
+        break;
+      case '"':
+        p->key = 1;
+        p->state = 's';
+
+        SEND_STRING(p, JF_TYPE_BGN_STRING, 0, 0);
+
+        break;
+      case '}':
+        POP_CONTAINER(p);
+        SEND(p, JF_TYPE_END_OBJECT);
+        END_VALUE(p);
+
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CL_SQ_BRACKET_QUOTE_SPACE;
+      }
+
+      break;
+    case ':':
+      switch (buf[i]) {
+      CASE_WHITESPACE
+        /* skip whitespace */
+        SKIP_WHITESPACE();
+        break;
+      case ':':
+        p->state = 'v';
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_COLON_SPACE;
+      }
+
+      break;
+    case 'v':
+      FILTER_VALUE(p);
+
+      switch (buf[i]) {
+      ACCEPT_EXPR(p, buf)
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_EXPR;
+      }
+
+      break;
+    case 'c':
+      switch (buf[i]) {
+      CASE_WHITESPACE
+        /* skip whitespace */
+        SKIP_WHITESPACE();
+        break;
+      case ',':
+        p->state = 'o';
+        break;
+      case '}':
+        p->state = 'o';
+        goto retry;
+
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_CL_SQ_BRACKET_COMMA_SPACE;
+      }
+
+      break;
+
+    /****************/
+    /* string state */
+    /****************/
+
+    case 's':
+      /* check for characters split by a quote, backslash, etc */
+      if (p->utf8 != UTF8_ACCEPT && IS_STRING_END(buf[i]))
+        return JF_ERR_INVALID_TOKEN_BAD_UTF8_BYTE;
+
+      /* check for high surrogate escape without low surrogate escape */
+      if (p->surrogate && buf[i] != '\\')
+        UNPAIRED_SURROGATE(p);
+
+      /* check for control characters */
+      if (buf[i] >= ' ') {
+        switch (buf[i]) {
+        case '"':
+          SEND_STRING_FRAGMENT(p);
+
+          if (p->key) {
+            /* end of object key, expect colon next */
+            p->state = ':';
+            SEND_STRING(p, JF_TYPE_END_STRING, 0, 0);
+            p->key = 0;
+          } else {
+            SEND_STRING(p, JF_TYPE_END_STRING, 0, 0);
+            END_VALUE(p);
+          }
+
+          break;
+        case '\\':
+          p->state = '\\';
+          break;
+        default:
+          /* 
+           * find the end of this run of ordinary characters and
+           * copy the whole run at once, rather than going back 
+           * through the state machine for every byte
+           */
+          j = scan_string(buf, i + 1, buf_len);
+
+          /* check run for valid UTF-8 */
+          if (!(p->flags & JF_FLAG_IGNORE_RFC3629)) {
+            k = check_utf8(buf, i, j, &(p->utf8));
+
+            if (k < j) {
+              p->num_bytes = base + k;
+              return JF_ERR_INVALID_TOKEN_BAD_UTF8_BYTE;
+            }
+          }
+
+          if ((p->flags & JF_FLAG_ZERO_COPY) || p->batch) {
+            /* send pending escapes, then send run from input */
+            SEND_STRING_FRAGMENT(p);
+            SEND_STRING(p, JF_TYPE_STRING_FRAGMENT, buf + i, j - i);
+          } else {
+            PUSH_RUN(p, buf + i, j - i);
+          }
+
+          /* resume at the byte that ended the run */
+          i = j - 1;
+        }
+      } else {
+        return JF_ERR_INVALID_TOKEN_EMBEDDED_CTRL_CHAR;
+      }
+
+      break;
+    case '\\':
+      /* check for high surrogate escape without low surrogate escape */
+      if (p->surrogate && buf[i] != 'u')
+        UNPAIRED_SURROGATE(p);
+
+      switch (buf[i]) {
+      case '"':
+      case '/':
+      case '\\':
+        PUSH_CHAR(p, buf[i]);
+        p->state = 's';
+        break;
+      case 'b':
+        PUSH_CHAR(p, '\b');
+        p->state = 's';
+        break;
+      case 'f':
+        PUSH_CHAR(p, '\f');
+        p->state = 's';
+        break;
+      case 'n':
+        PUSH_CHAR(p, '\n');
+        p->state = 's';
+        break;
+      case 'r':
+        PUSH_CHAR(p, '\r');
+        p->state = 's';
+        break;
+      case 't':
+        PUSH_CHAR(p, '\t');
+        p->state = 's';
+        break;
+      case 'u':
+        /* handle unicode escape */
+        p->hex = 0;
+        p->state = 'u';
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_BAD_ESCAPE_CHAR;
+      }
+
+      break;
+    case 'u':
+      switch (buf[i]) {
+      CASE_HEX
+        p->hex = (p->hex << 4) | FROM_HEX(buf[i]);
+        p->state = '1';
+
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_HEX;
+      };
+
+      break;
+    case '1':
+      switch (buf[i]) {
+      CASE_HEX
+        p->hex = (p->hex << 4) | FROM_HEX(buf[i]);
+        p->state = '2';
+
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_HEX;
+      };
+
+      break;
+    case '2':
+      switch (buf[i]) {
+      CASE_HEX
+        p->hex = (p->hex << 4) | FROM_HEX(buf[i]);
+        p->state = '3';
 
         break;
-      case 'e':
-        switch (buf[i]) {
-        CASE_DIGIT
-        case '+':
-        case '-':
-          POP_STATE(p);
-          PUSH_STATE(p, 'g');
-          PUSH_NUM(p, buf[i]);
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_DIGIT_PLUS_MINUS;
-        }
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_HEX;
+      };
+
+      break;
+    case '3':
+      switch (buf[i]) {
+      CASE_HEX
+        p->hex = (p->hex << 4) | FROM_HEX(buf[i]);
+        p->state = 's';
+
+        /* decode unicode escape */
+        if ((err = decode_escape(p)) != JF_OK)
+          return err;
 
         break;
-      case 'g':
-        switch (buf[i]) {
-        CASE_DIGIT
-          PUSH_NUM(p, buf[i]);
-          break;
-        CASE_END_NUM
-          /* send number */
-          SEND_FULL(p, JF_TYPE_FLOAT, p->buf, p->buf_len);
-          p->buf_len = 0;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_HEX;
+      };
 
-          /* pop state and retry token */
-          POP_STATE(p);
-          goto retry;
+      break;
 
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_DIGIT_END_NUM;
-        }
+    /***************/
+    /* skip states */
+    /***************/
 
+    case 'k':
+      switch (buf[i]) {
+      case '"':
+        p->state = 'q';
         break;
-      /*****************/
-      /* "null" states */
-      /*****************/
+      case '{':
+      case '[':
+        p->skip_depth++;
+        break;
+      case '}':
+      case ']':
+        if (!--p->skip_depth)
+          END_VALUE(p);
 
-      case 'N':
-        if (buf[i] == 'u') {
-          PUSH_STATE(p, 'U');
-        } else {
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_U;
-        }
+        break;
+      default:
+        /* jump to next quote or bracket */
+        i = scan_skip(buf, i + 1, buf_len) - 1;
+      }
+
+      break;
+    case 'q':
+      switch (buf[i]) {
+      case '"':
+        if (p->skip_depth)
+          p->state = 'k';
+        else
+          END_VALUE(p);
 
         break;
-      case 'U':
-        if (buf[i] == 'l') {
-          PUSH_STATE(p, 'L');
-        } else {
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_L;
-        }
+      case '\\':
+        p->state = 'Q';
+        break;
+      default:
+        /* jump to next quote or backslash */
+        i = scan_string(buf, i + 1, buf_len) - 1;
+      }
 
+      break;
+    case 'Q':
+      /* skip escaped character */
+      p->state = 'q';
+      break;
+    case 'K':
+      /* skipped member value (see skip_value()), expect colon */
+      switch (buf[i]) {
+      CASE_WHITESPACE
+        /* skip whitespace */
+        SKIP_WHITESPACE();
+        break;
+      case ':':
+        p->state = 'V';
         break;
-      case 'L':
-        if (buf[i] == 'l') {
-          SEND(p, JF_TYPE_NULL);
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_COLON_SPACE;
+      }
 
-          POP_STATE(p);
-          POP_STATE(p);
-          POP_STATE(p);
-        } else {
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_L;
-        }
+      break;
+    case 'V':
+      switch (buf[i]) {
+      CASE_WHITESPACE
+        /* skip whitespace */
+        SKIP_WHITESPACE();
+        break;
+      case '{':
+      case '[':
+        p->skip_depth = 1;
+        p->state = 'k';
+        break;
+      case '"':
+        p->skip_depth = 0;
+        p->state = 'q';
+        break;
+      case 't':
+      case 'f':
+      case 'n':
+      case '-':
+      CASE_DIGIT
+        p->state = 'X';
+        break;
+      default:
+        return JF_ERR_INVALID_TOKEN_EXPECTED_EXPR;
+      }
 
+      break;
+    case 'X':
+      /* skip number or literal */
+      switch (buf[i]) {
+      CASE_WHITESPACE
+      case ',':
+      case '}':
+      case ']':
+        END_VALUE(p);
+        goto retry;
+      default:
         break;
+      }
 
-      /*****************/
-      /* "true" states */
-      /*****************/
+      break;
+    default:
+      /* unknown state? probably memory corruption */
+      return JF_ERR_INVALID_STATE;
+    }
+  }
 
-      case 'T':
-        if (buf[i] == 'r') {
-          PUSH_STATE(p, 'R');
-        } else {
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_R;
-        }
+  /* save final byte count */
+  p->num_bytes = base + i;
+  *num_read = i;
 
+  /* if this is the final block, then make sure the state is sane */
+  if (!buf && !buf_len) {
+    switch (p->state) {
+    case ' ':
+      /* final state */
+      break;
+    case 0:
+      /* streams of documents may be empty */
+      if (p->flags & JF_FLAG_NDJSON)
         break;
-      case 'R':
-        if (buf[i] == 'u') {
-          PUSH_STATE(p, 'W');
-        } else {
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_U;
-        }
 
+      return JF_ERR_INVALID_FINAL_STATE_STACK_TOO_SMALL;
+    case 'i':
+      return JF_ERR_INVALID_FINAL_STATE_WRONG_VALUE;
+    case 'n':
+    case 'd':
+    case 'g':
+      /* the last document in a stream may end with a number */
+      if ((p->flags & JF_FLAG_NDJSON) && !p->depth && p->top == ' ') {
+        SEND_NUMBER(p, (p->state == 'n') ? JF_TYPE_INTEGER : JF_TYPE_FLOAT);
+        END_VALUE(p);
         break;
-      case 'W':
-        if (buf[i] == 'e') {
-          SEND(p, JF_TYPE_TRUE);
+      }
 
-          POP_STATE(p);
-          POP_STATE(p);
-          POP_STATE(p);
-        } else {
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_E;
-        }
+      return JF_ERR_INVALID_FINAL_STATE_STACK_TOO_BIG;
+    default:
+      return JF_ERR_INVALID_FINAL_STATE_STACK_TOO_BIG;
+    }
+  }
+  
+  /* return success */
+  return JF_OK;
+}
 
-        break;
+/*
+ * IS_END_NUM() - Does the given byte end a number?  Matches the same
+ * set of characters as CASE_END_NUM.
+ */
+#define IS_END_NUM(c) (IS_SPACE(c) || (c) == ',' || (c) == ']' || (c) == '}' || (c) == ')')
 
-      /******************/
-      /* "false" states */
-      /******************/
+/*
+ * IS_HEX() - Is the given byte a hex digit accepted by CASE_HEX?
+ */
+#define IS_HEX(c) (IS_DIGIT(c) || ((c) >= 'a' && (c) <= 'f') || ((c) >= 'A' && (c) <= 'F'))
 
-      case 'F':
-        if (buf[i] == 'a') {
-          PUSH_STATE(p, 'A');
-        } else {
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_A;
-        }
+/*
+ * validate_string() - Check the string whose contents start at offset
+ * i (and, if strict is set, that it's valid UTF-8 and that surrogate
+ * escapes are paired).  Returns the offset after the closing double
+ * quote, or 0 if the string is invalid or truncated.
+ */
+static size_t
+validate_string(const uint8_t *buf, size_t i, const size_t len, const int strict) {
+  uint8_t utf8 = UTF8_ACCEPT;
+  uint32_t v, surrogate = 0;
+  size_t j;
+
+  while (1) {
+    /* skip run of ordinary characters */
+    j = scan_string(buf, i, len);
+    if (strict && (check_utf8(buf, i, j, &utf8) < j || (surrogate && j > i)))
+      return 0;
+
+    /* check for truncated strings and split characters */
+    if ((i = j) >= len || utf8 != UTF8_ACCEPT)
+      return 0;
+
+    /* check for high surrogate escape without low surrogate escape */
+    if (surrogate && (buf[i] != '\\' || i + 1 >= len || buf[i + 1] != 'u'))
+      return 0;
+
+    switch (buf[i]) {
+    case '"':
+      return i + 1;
+    case '\\':
+      if (++i >= len)
+        return 0;
 
+      switch (buf[i]) {
+      case '"':
+      case '/':
+      case '\\':
+      case 'b':
+      case 'f':
+      case 'n':
+      case 'r':
+      case 't':
+        i++;
         break;
-      case 'A':
-        if (buf[i] == 'l') {
-          PUSH_STATE(p, 'M');
-        } else {
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_L;
-        }
+      case 'u':
+        if (len - i < 5)
+          return 0;
 
-        break;
-      case 'M':
-        if (buf[i] == 's') {
-          PUSH_STATE(p, 'S');
-        } else {
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_S;
+        /* decode escape */
+        for (v = 0, j = 1; j < 5; j++) {
+          if (!IS_HEX(buf[i + j]))
+            return 0;
+
+          v = (v << 4) | FROM_HEX(buf[i + j]);
         }
 
-        break;
-      case 'S':
-        if (buf[i] == 'e') {
-          SEND(p, JF_TYPE_FALSE);
+        i += 5;
+
+        /* check surrogate pairs */
+        if (strict) {
+          if (surrogate) {
+            if (!IS_LOW_SURROGATE(v))
+              return 0;
 
-          POP_STATE(p);
-          POP_STATE(p);
-          POP_STATE(p);
-          POP_STATE(p);
-        } else {
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CHAR_E;
+            surrogate = 0;
+          } else if (IS_HIGH_SURROGATE(v)) {
+            surrogate = v;
+          } else if (IS_LOW_SURROGATE(v)) {
+            return 0;
+          }
         }
 
         break;
+      default:
+        return 0;
+      }
 
-      /***************/
-      /* array state */
-      /***************/
+      break;
+    default:
+      /* control character */
+      return 0;
+    }
+  }
+}
 
-      case 'a':
-        switch (buf[i]) {
-        ACCEPT_EXPR(p, buf, ',')
-        case ']':
-          SEND(p, JF_TYPE_END_ARRAY);
-          
-          POP_STATE(p);
+/*
+ * validate_number() - Check the number starting at offset i.  Returns
+ * the offset of the byte which ended the number (or len if the number
+ * runs to the end of the buffer), or 0 if the number is invalid or too
+ * long for the default parser buffer.
+ */
+static size_t
+validate_number(const uint8_t *buf, size_t i, const size_t len) {
+  const size_t start = i;
+
+  /* skip sign and integer part */
+  if (buf[i] == '-')
+    i++;
+  while (i < len && IS_DIGIT(buf[i]))
+    i++;
+
+  /* skip fractional part */
+  if (i < len && buf[i] == '.') {
+    for (i++; i < len && IS_DIGIT(buf[i]); i++);
+  }
 
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CL_BRACKET_EXPR;
-        }
+  /* skip exponent (which needs at least a sign or a digit) */
+  if (i < len && (buf[i] == 'e' || buf[i] == 'E')) {
+    if (++i >= len || !(IS_DIGIT(buf[i]) || buf[i] == '-' || buf[i] == '+'))
+      return 0;
 
-        break;
-      case ',':
-        switch (buf[i]) {
-        CASE_WHITESPACE
-          /* ignore whitespace */
-          break;
-        case ',':
-          POP_STATE(p);
-          break;
-        case ']':
-          POP_STATE(p);
-          goto retry;
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CL_BRACKET_COMMA_SPACE;
-        }
+    for (i++; i < len && IS_DIGIT(buf[i]); i++);
+  }
 
-        break;
+  /* check for end of number and overlong numbers */
+  if ((i < len && !IS_END_NUM(buf[i])) || i - start >= JF_MAX_BUF_LEN)
+    return 0;
 
-      /****************/
-      /* object state */
-      /****************/
+  return i;
+}
 
-      case 'o':
-        switch (buf[i]) {
-        CASE_WHITESPACE
-          /* ignore whitespace */
-          break;
-        case '"':
-          PUSH_STATE(p, ':');
-          PUSH_STATE(p, 's');
+/*
+ * VALIDATE_SPACE() - Skip whitespace at buf[i] in validate().  Checks
+ * the first two bytes inline, since most whitespace runs are a single
+ * space (e.g. after commas and colons) or there isn't any at all.
+ */
+#define VALIDATE_SPACE() do {                       \
+  if (i < len && IS_SPACE(buf[i])) {                \
+    i++;                                            \
+    if (i < len && IS_SPACE(buf[i]))                \
+      i = scan_space(buf, i + 1, len);              \
+  }                                                 \
+} while (0)
 
-          SEND(p, JF_TYPE_BGN_STRING);
+/* is the innermost container an object? (in validate()) */
+#define VALIDATE_IN_OBJECT()                        \
+  (stack[(depth - 1) >> 3] & STACK_BIT(depth - 1))
 
-          break;
-        case '}':
-          POP_STATE(p);
+/*
+ * validate() - Check the given buffer without sending any tokens.
+ * Returns 1 if parse() would accept the buffer (with the default stack
+ * and buffer sizes), and 0 otherwise.
+ *
+ * Accepts exactly the same (lenient) grammar as parse(), but works on
+ * the whole buffer at once and consumes each value in one step, so
+ * there's no per-byte state dispatch and nothing is ever copied.
+ */
+static int
+validate(const uint8_t *buf, const size_t len, const uint32_t flags) {
+  const int strict = !(flags & JF_FLAG_IGNORE_RFC3629);
+  uint8_t stack[(JF_MAX_STACK_DEPTH + 7) / 8];
+  size_t i = 0, depth = 0;
+  int paren;
+
+next_document:
+  /* look for opening parenthesis or top-level value */
+  VALIDATE_SPACE();
+  if (i >= len)
+    return (flags & JF_FLAG_NDJSON) ? 1 : 0;
+
+  paren = (buf[i] == '(');
+  if (paren) {
+    i++;
+    VALIDATE_SPACE();
+    if (i >= len)
+      return 0;
+
+    /* empty parentheses */
+    if (buf[i] == ')') {
+      i++;
+      goto end_document;
+    }
+  }
 
-          SEND(p, JF_TYPE_END_OBJECT);
+value:
+  /* expect a value at buf[i] */
+  switch (buf[i]) {
+  case '{':
+  case '[':
+    /* check for stack overflow */
+    if (depth >= JF_MAX_STACK_DEPTH)
+      return 0;
+
+    /* push container */
+    if (buf[i] == '{')
+      stack[depth >> 3] |= STACK_BIT(depth);
+    else
+      stack[depth >> 3] &= ~STACK_BIT(depth);
+    depth++;
+
+    i++;
+    VALIDATE_SPACE();
+    if (i >= len)
+      return 0;
+
+    /* check for empty container */
+    if (buf[i] == (VALIDATE_IN_OBJECT() ? '}' : ']')) {
+      depth--;
+      i++;
+      goto end_value;
+    }
 
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CL_SQ_BRACKET_QUOTE_SPACE;
-        }
+    /* expect first member or element */
+    if (VALIDATE_IN_OBJECT())
+      goto key;
 
-        break;
-      case ':':
-        switch (buf[i]) {
-        CASE_WHITESPACE
-          /* ignore whitespace */
-          break;
-        case ':':
-          PUSH_STATE(p, 'v');
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_COLON_SPACE;
-        }
+    goto value;
+  case '"':
+    if (!(i = validate_string(buf, i + 1, len, strict)))
+      return 0;
 
-        break;
-      case 'v':
-        switch (buf[i]) {
-        ACCEPT_EXPR(p, buf, 'c')
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_EXPR;
-        }
+    goto end_value;
+  case 't':
+    if (len - i < 4 || memcmp(buf + i, "true", 4))
+      return 0;
 
-        break;
-      case 'c':
-        switch (buf[i]) {
-        CASE_WHITESPACE
-          /* ignore whitespace */
-          break;
-        case ',':
-          POP_STATE(p);
-          POP_STATE(p);
-          POP_STATE(p);
+    i += 4;
+    goto end_value;
+  case 'f':
+    if (len - i < 5 || memcmp(buf + i, "false", 5))
+      return 0;
+
+    i += 5;
+    goto end_value;
+  case 'n':
+    if (len - i < 4 || memcmp(buf + i, "null", 4))
+      return 0;
+
+    i += 4;
+    goto end_value;
+  CASE_DIGIT
+  case '-':
+    if (!(i = validate_number(buf, i, len)))
+      return 0;
+
+    /* only the last document in a stream may end with a number */
+    if (i >= len)
+      return ((flags & JF_FLAG_NDJSON) && !depth && !paren) ? 1 : 0;
+
+    goto end_value;
+  default:
+    return 0;
+  }
 
-          break;
-        case '}':
-          POP_STATE(p);
-          POP_STATE(p);
-          POP_STATE(p);
-          goto retry;
+key:
+  /* expect object key at buf[i], then colon and value */
+  if (buf[i] != '"' || !(i = validate_string(buf, i + 1, len, strict)))
+    return 0;
+
+  VALIDATE_SPACE();
+  if (i >= len || buf[i] != ':')
+    return 0;
+
+  i++;
+  VALIDATE_SPACE();
+  if (i >= len)
+    return 0;
+
+  goto value;
+
+end_value:
+  /* expect comma or end of container after value */
+  VALIDATE_SPACE();
+
+  if (depth) {
+    if (i >= len)
+      return 0;
+
+    if (VALIDATE_IN_OBJECT()) {
+      /* in object */
+      if (buf[i] == ',') {
+        i++;
+        VALIDATE_SPACE();
+        if (i >= len)
+          return 0;
+
+        /* allow trailing comma */
+        if (buf[i] != '}')
+          goto key;
+      } else if (buf[i] != '}') {
+        return 0;
+      }
+    } else {
+      /* in array */
+      if (buf[i] == ',') {
+        i++;
+        VALIDATE_SPACE();
+        if (i >= len)
+          return 0;
+
+        /* allow trailing comma */
+        if (buf[i] != ']')
+          goto value;
+      } else if (buf[i] != ']') {
+        return 0;
+      }
+    }
 
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_CL_SQ_BRACKET_COMMA_SPACE;
-        }
+    /* end container */
+    depth--;
+    i++;
+    goto end_value;
+  }
 
-        break;
+  /* end of top-level value; expect closing parenthesis */
+  if (paren) {
+    if (i >= len || buf[i] != ')')
+      return 0;
 
-      /****************/
-      /* string state */
-      /****************/
+    i++;
+  }
 
-      case 's':
-        /* check for control characters */
-        if (buf[i] >= ' ') {
-          CHECK_UTF8_BYTE(p, buf[i]);
+end_document:
+  /* look for next document */
+  if (flags & JF_FLAG_NDJSON)
+    goto next_document;
 
-          switch (buf[i]) {
-          case '"':
-            SEND_STRING_FRAGMENT(p);
-            SEND(p, JF_TYPE_END_STRING);
-            POP_STATE(p);
-            break;
-          case '\\':
-            PUSH_STATE(p, '\\');
-            break;
-          default:
-            PUSH_CHAR(p, buf[i]);
-          }
-        } else {
-          return JF_ERR_INVALID_TOKEN_EMBEDDED_CTRL_CHAR;
-        }
+  /* expect trailing whitespace */
+  VALIDATE_SPACE();
+  return (i == len) ? 1 : 0;
+}
 
-        break;
-      case '\\':
-        switch (buf[i]) {
-        case '"':
-        case '/':
-        case '\\':
-          PUSH_CHAR(p, buf[i]);
-          POP_STATE(p);
-          break;
-        case 'b':
-          PUSH_CHAR(p, '\b');
-          POP_STATE(p);
-          break;
-        case 'f':
-          PUSH_CHAR(p, '\f');
-          POP_STATE(p);
-          break;
-        case 'n':
-          PUSH_CHAR(p, '\n');
-          POP_STATE(p);
-          break;
-        case 'r':
-          PUSH_CHAR(p, '\r');
-          POP_STATE(p);
-          break;
-        case 't':
-          PUSH_CHAR(p, '\t');
-          POP_STATE(p);
-          break;
-        case 'u':
-          /* handle unicode escape */
-          POP_STATE(p);
-          PUSH_STATE(p, 'u');
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_BAD_ESCAPE_CHAR;
-        }
+jf_err_t
+jf_validate(const uint8_t *buf, const size_t len, const uint32_t flags, size_t *err_ofs) {
+  jf_err_t err;
+  jf_t p;
 
-        break;
-      case 'u':
-        switch (buf[i]) {
-        CASE_HEX
-          /* flush pending string fragment so we don't end up on a 
-           * buffer boundary when mucking around with utf8 chars */
-          SEND_STRING_FRAGMENT(p);
+  /* fast path: check whole buffer without parsing */
+  if (validate(buf, len, flags)) {
+    if (err_ofs)
+      *err_ofs = len;
 
-          PUSH_CHAR(p, buf[i]);
-          POP_STATE(p);
-          PUSH_STATE(p, '1');
+    return JF_OK;
+  }
 
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_HEX;
-        };
+  /* 
+   * slow path: parse the buffer without a callback to find the error
+   * code and offset
+   */
+  jf_init(&p, NULL);
+  p.flags = flags | JF_FLAG_ZERO_COPY;
+  if ((err = jf_parse(&p, buf, len)) == JF_OK)
+    err = jf_done(&p);
 
-        break;
-      case '1':
-        switch (buf[i]) {
-        CASE_HEX
-          PUSH_CHAR(p, buf[i]);
-          POP_STATE(p);
-          PUSH_STATE(p, '2');
+  if (err_ofs)
+    *err_ofs = p.num_bytes;
 
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_HEX;
-        };
+  /* return result */
+  return err;
+}
 
-        break;
-      case '2':
-        switch (buf[i]) {
-        CASE_HEX
-          PUSH_CHAR(p, buf[i]);
-          POP_STATE(p);
-          PUSH_STATE(p, '3');
+/*
+ * Checkpoint format (see jf_checkpoint()): a magic string and version
+ * byte, followed by the parser fields as bytes, variable-length
+ * unsigned integers (7 bits per byte, least significant first), and
+ * byte strings (a length followed by the bytes).  The container stack
+ * is saved as depth bits, 8 to a byte.
+ */
+#define CHECKPOINT_MAGIC "JF"
 
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_HEX;
-        };
+/* checkpoint flags */
+#define CHECKPOINT_FILTER     (1 << 0) /* includes filter state */
+#define CHECKPOINT_NUM_TRUNC  (1 << 1) /* number was truncated */
+#define CHECKPOINT_NUM_NEG    (1 << 2) /* number is negative */
+#define CHECKPOINT_EXP_NEG    (1 << 3) /* exponent is negative */
 
-        break;
-      case '3':
-        switch (buf[i]) {
-        CASE_HEX
-          PUSH_CHAR(p, buf[i]);
-          
-          /* decode unicode hex sequence */
-          if ((err = decode_utf8(p)) != JF_OK)
-            return err;
+/*
+ * zigzag() and unzigzag() - Map signed integers to and from unsigned
+ * integers, so small negative values stay small.
+ */
+static uint64_t
+zigzag(int64_t v) {
+  return (v < 0) ? ((((uint64_t) -(v + 1)) << 1) | 1) : (((uint64_t) v) << 1);
+}
 
-          POP_STATE(p);
+static int64_t
+unzigzag(uint64_t v) {
+  return (v & 1) ? -(int64_t) (v >> 1) - 1 : (int64_t) (v >> 1);
+}
 
-          break;
-        default:
-          return JF_ERR_INVALID_TOKEN_EXPECTED_HEX;
-        };
+/*
+ * writer_t - Checkpoint writer.  Counts bytes even after the buffer is
+ * full, so the required size is known.
+ */
+typedef struct {
+  uint8_t *buf;
+  size_t size, len;
+} writer_t;
+
+static void
+put_byte(writer_t *w, uint8_t c) {
+  if (w->len < w->size)
+    w->buf[w->len] = c;
+  w->len++;
+}
 
-        break;
-      default:
-        /* unknown state? probably memory corruption */
-        return JF_ERR_INVALID_STATE;
-      }
+static void
+put_uint(writer_t *w, uint64_t v) {
+  for (; v >= 0x80; v >>= 7)
+    put_byte(w, (uint8_t) (v & 0x7f) | 0x80);
+  put_byte(w, (uint8_t) v);
+}
+
+static void
+put_bytes(writer_t *w, const uint8_t *str, size_t len) {
+  size_t i;
+
+  put_uint(w, len);
+  for (i = 0; i < len; i++)
+    put_byte(w, str[i]);
+}
+
+jf_err_t
+jf_checkpoint(const jf_t *p, uint8_t *buf, size_t buf_size, size_t *len) {
+  const jf_filter_t *f = p->filter;
+  uint8_t flags = 0;
+  size_t i, key_len;
+  writer_t w;
+
+  w.buf = buf;
+  w.size = buf ? buf_size : 0;
+  w.len = 0;
+
+  /* get checkpoint flags */
+  if (f)
+    flags |= CHECKPOINT_FILTER;
+  if (p->num_trunc)
+    flags |= CHECKPOINT_NUM_TRUNC;
+  if (p->num_neg)
+    flags |= CHECKPOINT_NUM_NEG;
+  if (p->num_exp_neg)
+    flags |= CHECKPOINT_EXP_NEG;
+
+  /* write header */
+  put_byte(&w, CHECKPOINT_MAGIC[0]);
+  put_byte(&w, CHECKPOINT_MAGIC[1]);
+  put_byte(&w, JF_CHECKPOINT_VERSION);
+  put_byte(&w, flags);
+
+  /* write parser state */
+  put_uint(&w, p->flags);
+  put_uint(&w, p->num_bytes);
+  put_byte(&w, p->state);
+  put_byte(&w, p->top);
+  put_byte(&w, p->key);
+  put_byte(&w, p->utf8);
+  put_uint(&w, p->hex);
+  put_uint(&w, p->surrogate);
+  put_uint(&w, p->skip_depth);
+
+  /* write container stack */
+  put_bytes(&w, p->stack, (p->depth + 7) / 8);
+  put_uint(&w, p->depth);
+
+  /* write partial string fragment or number */
+  put_bytes(&w, p->buf, p->buf_len);
+
+  /* write number accumulator */
+  put_uint(&w, p->num_mant);
+  put_uint(&w, zigzag(p->num_exp));
+  put_uint(&w, zigzag(p->num_exp10));
+  put_byte(&w, p->num_digits);
+
+  /* write key hash and ID (plus one, so JF_KEY_NONE is one byte) */
+  put_uint(&w, p->key_hash);
+  put_uint(&w, (uint32_t) (p->key_id + 1));
+
+  /* write partial key */
+  key_len = p->key_buf ? p->key_buf->len : 0;
+  put_uint(&w, key_len);
+  put_bytes(&w, key_len ? p->key_buf->buf : NULL, (key_len < JF_MAX_KEY_LEN) ? key_len : JF_MAX_KEY_LEN);
+
+  if (f) {
+    /* write filter state */
+    put_uint(&w, f->num_paths);
+    put_uint(&w, f->match);
+    put_byte(&w, f->emit);
+    put_uint(&w, f->emit_depth);
+    put_uint(&w, f->key_mask);
+    put_uint(&w, f->key_len);
+
+    /* write live paths and element counts for each level */
+    for (i = 0; i <= JF_MAX_PATH_STEPS && i <= p->depth; i++) {
+      put_uint(&w, f->mask[i]);
+      put_uint(&w, f->index[i]);
     }
   }
 
-  /* save final byte count */
-  p->num_bytes = base + buf_len;
+  /* save length */
+  *len = w.len;
 
-  /* if this is the final block, then make sure the stack is sane */
-  if (!buf && !buf_len) {
-    if (p->sp == 1) {
-      /* check for final state */
-      if (p->stack[0] != ' ')
-        return JF_ERR_INVALID_FINAL_STATE_WRONG_VALUE;
-    } else if (p->sp > 1) {
-      return JF_ERR_INVALID_FINAL_STATE_STACK_TOO_BIG;
-    } else {
-      return JF_ERR_INVALID_FINAL_STATE_STACK_TOO_SMALL;
+  /* return result */
+  return (w.len > w.size) ? JF_ERR_STORAGE_TOO_SMALL : JF_OK;
+}
+
+/*
+ * reader_t - Checkpoint reader.  Reads past the end of the buffer set
+ * the error flag (and return zeros).
+ */
+typedef struct {
+  const uint8_t *buf;
+  size_t len, ofs;
+  int err;
+} reader_t;
+
+static uint8_t
+get_byte(reader_t *r) {
+  if (r->ofs < r->len)
+    return r->buf[r->ofs++];
+
+  r->err = 1;
+  return 0;
+}
+
+static uint64_t
+get_uint(reader_t *r) {
+  uint64_t v = 0;
+  uint8_t c;
+  int shift;
+
+  for (shift = 0; shift < 64; shift += 7) {
+    c = get_byte(r);
+    v |= ((uint64_t) (c & 0x7f)) << shift;
+
+    if (!(c & 0x80))
+      return v;
+  }
+
+  /* too many bytes */
+  r->err = 1;
+  return 0;
+}
+
+/*
+ * get_bytes() - Read a byte string into dst, which holds at most
+ * max_len bytes, and save its length.  Returns JF_ERR_STORAGE_TOO_SMALL
+ * if the string is too long for dst.
+ */
+static jf_err_t
+get_bytes(reader_t *r, uint8_t *dst, size_t max_len, size_t *len) {
+  size_t n = get_uint(r);
+
+  if (n > r->len - r->ofs) {
+    r->err = 1;
+    return JF_ERR_INVALID_CHECKPOINT;
+  }
+
+  if (n > max_len)
+    return JF_ERR_STORAGE_TOO_SMALL;
+
+  memcpy(dst, r->buf + r->ofs, n);
+  r->ofs += n;
+  *len = n;
+
+  return JF_OK;
+}
+
+jf_err_t
+jf_restore(jf_t *p, const uint8_t *buf, size_t len) {
+  jf_filter_t *f = p->filter;
+  size_t i, stack_len, key_len, key_buf_len;
+  uint8_t flags, key[JF_MAX_KEY_LEN];
+  jf_err_t err;
+  reader_t r;
+
+  r.buf = buf;
+  r.len = len;
+  r.ofs = 0;
+  r.err = 0;
+
+  /* check header */
+  if (get_byte(&r) != CHECKPOINT_MAGIC[0] || 
+      get_byte(&r) != CHECKPOINT_MAGIC[1] ||
+      get_byte(&r) != JF_CHECKPOINT_VERSION)
+    return JF_ERR_INVALID_CHECKPOINT;
+
+  /* check for filter */
+  flags = get_byte(&r);
+  if (!(flags & CHECKPOINT_FILTER) != !f)
+    return JF_ERR_INVALID_CHECKPOINT;
+
+  /* read parser state */
+  p->flags = get_uint(&r);
+  p->num_bytes = get_uint(&r);
+  p->state = get_byte(&r);
+  p->top = get_byte(&r);
+  p->key = get_byte(&r);
+  p->utf8 = get_byte(&r);
+  p->hex = get_uint(&r);
+  p->surrogate = get_uint(&r);
+  p->skip_depth = get_uint(&r);
+
+  /* check UTF-8 validator state */
+  if (p->utf8 >= sizeof(utf8_states) / sizeof(utf8_states[0]))
+    return JF_ERR_INVALID_CHECKPOINT;
+
+  /* read container stack */
+  if ((err = get_bytes(&r, p->stack, p->stack_size, &stack_len)) != JF_OK)
+    return err;
+  p->depth = get_uint(&r);
+  if (p->depth > 8 * stack_len || (p->depth + 7) / 8 != stack_len)
+    return JF_ERR_INVALID_CHECKPOINT;
+
+  /* read partial string fragment or number */
+  if ((err = get_bytes(&r, p->buf, p->buf_size - 1, &p->buf_len)) != JF_OK)
+    return err;
+
+  /* read number accumulator */
+  p->num_mant = get_uint(&r);
+  p->num_exp = unzigzag(get_uint(&r));
+  p->num_exp10 = unzigzag(get_uint(&r));
+  p->num_digits = get_byte(&r);
+  p->num_trunc = (flags & CHECKPOINT_NUM_TRUNC) ? 1 : 0;
+  p->num_neg = (flags & CHECKPOINT_NUM_NEG) ? 1 : 0;
+  p->num_exp_neg = (flags & CHECKPOINT_EXP_NEG) ? 1 : 0;
+
+  /* read key hash and ID */
+  p->key_hash = get_uint(&r);
+  p->key_id = (uint32_t) get_uint(&r) - 1;
+
+  /* read partial key (and drop it if there's no key buffer) */
+  key_len = get_uint(&r);
+  if ((err = get_bytes(&r, p->key_buf ? p->key_buf->buf : key, JF_MAX_KEY_LEN, &key_buf_len)) != JF_OK)
+    return err;
+  if (key_buf_len != ((key_len < JF_MAX_KEY_LEN) ? key_len : JF_MAX_KEY_LEN))
+    return JF_ERR_INVALID_CHECKPOINT;
+  if (p->key_buf)
+    p->key_buf->len = key_len;
+
+  if (f) {
+    /* read filter state */
+    if (get_uint(&r) != f->num_paths)
+      return JF_ERR_INVALID_CHECKPOINT;
+
+    f->match = get_uint(&r);
+    f->emit = get_byte(&r);
+    f->emit_depth = get_uint(&r);
+    f->key_mask = get_uint(&r);
+    f->key_len = get_uint(&r);
+
+    /* read live paths and element counts for each level */
+    for (i = 0; i <= JF_MAX_PATH_STEPS && i <= p->depth; i++) {
+      f->mask[i] = get_uint(&r);
+      f->index[i] = get_uint(&r);
     }
   }
-  
+
+  /* check for truncated or trailing data */
+  if (r.err || r.ofs != r.len)
+    return JF_ERR_INVALID_CHECKPOINT;
+
   /* return success */
   return JF_OK;
 }
+
+jf_err_t
+jf_parse(jf_t *p, const uint8_t *buf, const size_t buf_len) {
+  size_t num_read;
+  return parse(p, buf, buf_len, &num_read);
+}
+
+jf_err_t
+jf_parse_batch(jf_t *p, jf_batch_t *b, const uint8_t *buf, const size_t buf_len, size_t *num_read) {
+  jf_err_t err;
+
+  /* check batch size */
+  if (b->max_tokens < JF_MIN_BATCH_TOKENS || b->data_size < p->buf_size + JF_BATCH_DATA_SLACK)
+    return JF_ERR_STORAGE_TOO_SMALL;
+
+  /* clear batch */
+  b->num_tokens = 0;
+  b->data_len = 0;
+
+  /* parse into batch */
+  p->batch = b;
+  err = parse(p, buf, buf_len, num_read);
+  p->batch = 0;
+
+  /* return result */
+  return err;
+}
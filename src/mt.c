@@ -0,0 +1,902 @@
+/*
+ * Jiffy - Fast, lighweight, and reentrant JSON stream parser.
+ *  
+ * Copyright (C) 2009 Paul Duncan <pabs@pablotron.org>
+ *  
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *   
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the of the
+ * Software.
+ *    
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.  
+ *  
+ */
+
+
+#include <stdlib.h> /* for malloc(), realloc(), free() */
+#include <string.h> /* for memset(), memcpy(), memchr() */
+#include <pthread.h>
+#include <jiffy/mt.h>
+
+/* target chunk size, in bytes */
+#define CHUNK_SIZE (256 * 1024)
+
+/* maximum number of parsed chunks waiting for delivery, per thread */
+#define CHUNKS_PER_THREAD 2
+
+/* number of tokens per batch when parsing a chunk */
+#define BATCH_SIZE 256
+
+/* initial size of chunk token array */
+#define MIN_TOKENS 1024
+
+/*
+ * parser_t - A parser and its key buffer.
+ */
+typedef struct {
+  jf_t parser;
+  jf_key_buf_t key_buf;
+} parser_t;
+
+/*
+ * chunk_t - A chunk of input and the tokens parsed from it.
+ */
+typedef struct {
+  /* offset and length of chunk in input */
+  size_t ofs, len;
+
+  /* parsed tokens */
+  jf_token_t *tokens;
+  size_t num_tokens, max_tokens;
+
+  /* copied token values (at most len bytes) */
+  uint8_t *data;
+  size_t data_len;
+
+  /* parse result, and offset of error (or end of chunk) */
+  jf_err_t err;
+  size_t end_ofs;
+
+  /* parser, kept until the next chunk is delivered */
+  parser_t *p;
+
+  /* has this chunk been parsed? */
+  int done;
+} chunk_t;
+
+/*
+ * pool_t - Worker pool state, shared by all threads.
+ */
+typedef struct {
+  /* input buffer, parser flags, and key map */
+  const uint8_t *buf;
+  size_t len;
+  uint32_t flags;
+  const jf_keymap_t *keymap;
+
+  /* 
+   * state each chunk but the first starts in (after a comma in the 
+   * root container of a single document, 'a' or 'o', or between 
+   * records, 0), and top-level final state (single document only)
+   */
+  uint8_t root, top;
+
+  /* chunks */
+  chunk_t *chunks;
+  size_t num_chunks;
+
+  /* next chunk to parse, next chunk to deliver, and delivery window */
+  size_t next_chunk, next_deliver, window;
+
+  /* set to stop workers */
+  int stop;
+
+  /* 
+   * caller's parser, depth of the value being skipped (see JF_SKIP), 
+   * and is the next value skipped? (delivery thread only) 
+   */
+  jf_t *parser;
+  size_t skip;
+  int skip_next;
+
+  /* 
+   * send key tokens to the caller as string tokens? (workers always 
+   * parse with JF_FLAG_KEY_TOKENS, so keys can be told from strings)
+   */
+  int key_strings;
+
+  /* lock protecting the fields above, and condition variables */
+  pthread_mutex_t mutex;
+  pthread_cond_t work_cv, done_cv;
+} pool_t;
+
+/*
+ * split_lines() - Split the input buffer into chunks of about
+ * CHUNK_SIZE bytes which end at newlines.  Returns NULL if memory 
+ * couldn't be allocated.
+ */
+static chunk_t *
+split_lines(const uint8_t *buf, size_t len, size_t *num_chunks) {
+  chunk_t *r;
+  const uint8_t *nl;
+  size_t i, ofs, end;
+
+  /* allocate chunks (one more than necessary, so there's always one) */
+  if ((r = calloc(len / CHUNK_SIZE + 1, sizeof(chunk_t))) == NULL)
+    return NULL;
+
+  for (i = 0, ofs = 0; ofs < len; i++, ofs = end) {
+    /* end chunk after the first newline past the target size */
+    end = ofs + CHUNK_SIZE;
+    if (end >= len || (nl = memchr(buf + end, '\n', len - end)) == NULL)
+      end = len;
+    else
+      end = nl - buf + 1;
+
+    r[i].ofs = ofs;
+    r[i].len = end - ofs;
+  }
+
+  /* return chunks */
+  *num_chunks = i;
+  return r;
+}
+
+/*
+ * block_t - Result of classifying one block of a single document,
+ * assuming the block does not start with an escaped byte.
+ */
+typedef struct {
+  /* number of unescaped double quotes (mod 2) */
+  int parity;
+
+  /* does the block end with an unfinished escape? */
+  int escape;
+
+  /* 
+   * net bracket depth change, counting brackets at even quote parity 
+   * (delta[0]) or odd quote parity (delta[1]) 
+   */
+  long delta[2];
+} block_t;
+
+/*
+ * classify() - Classify a block of a single document.  Backslashes
+ * escape the next byte whether or not they are in a string (they're
+ * invalid anywhere else), so the quote parity and bracket counts only
+ * depend on whether the block starts with an escaped byte.
+ */
+static void
+classify(const uint8_t *buf, size_t len, block_t *r) {
+  size_t i;
+
+  memset(r, 0, sizeof(block_t));
+
+  for (i = 0; i < len; i++) {
+    switch (buf[i]) {
+    case '\\':
+      /* skip escaped byte */
+      if (++i == len)
+        r->escape = 1;
+
+      break;
+    case '"':
+      r->parity ^= 1;
+      break;
+    case '[':
+    case '{':
+      r->delta[r->parity]++;
+      break;
+    case ']':
+    case '}':
+      r->delta[r->parity]--;
+      break;
+    }
+  }
+}
+
+/*
+ * classify_args_t - Arguments for classify_blocks().
+ */
+typedef struct {
+  const uint8_t *buf;
+  size_t len;
+
+  /* results, two per block (for unescaped and escaped starts) */
+  block_t *blocks;
+  size_t num_blocks;
+
+  /* thread number and number of threads */
+  size_t thread, num_threads;
+} classify_args_t;
+
+/*
+ * classify_blocks() - Classify every Nth block of a document, both with
+ * and without an escaped first byte.  Runs on its own thread.
+ */
+static void *
+classify_blocks(void *arg) {
+  classify_args_t *a = (classify_args_t*) arg;
+  const uint8_t *buf;
+  size_t i, len;
+
+  for (i = a->thread; i < a->num_blocks; i += a->num_threads) {
+    buf = a->buf + i * CHUNK_SIZE;
+    len = (i + 1 < a->num_blocks) ? CHUNK_SIZE : a->len - i * CHUNK_SIZE;
+
+    classify(buf, len, a->blocks + 2 * i);
+    classify(buf + 1, len - 1, a->blocks + 2 * i + 1);
+  }
+
+  return NULL;
+}
+
+/*
+ * find_split() - Find the end of the first comma in the root container
+ * between ofs and end, given the quote state, escape state, and depth
+ * at ofs.  Returns 0 if there isn't one.
+ */
+static size_t
+find_split(const uint8_t *buf, size_t ofs, size_t end, int in_str, int escape, long depth) {
+  size_t i;
+
+  for (i = ofs + (escape ? 1 : 0); i < end; i++) {
+    switch (buf[i]) {
+    case '\\':
+      i++;
+      break;
+    case '"':
+      in_str ^= 1;
+      break;
+    case '[':
+    case '{':
+      if (!in_str)
+        depth++;
+      break;
+    case ']':
+    case '}':
+      if (!in_str)
+        depth--;
+      break;
+    case ',':
+      if (!in_str && depth == 1)
+        return i + 1;
+      break;
+    }
+  }
+
+  /* return failure */
+  return 0;
+}
+
+/*
+ * split_document() - Split a single document into chunks of about
+ * CHUNK_SIZE bytes which end with a comma in the root container.
+ *
+ * Phase one classifies blocks of the document in parallel.  Phase two
+ * is a prefix scan over the results, which gives the exact quote
+ * state and depth at the start of each block, and from there the first
+ * root-level comma in each block.  Returns NULL if memory couldn't be
+ * allocated.
+ */
+static chunk_t *
+split_document(const uint8_t *buf, size_t len, size_t num_threads, size_t *num_chunks) {
+  classify_args_t *args;
+  pthread_t *threads;
+  size_t i, n, ofs, end, num_blocks, num_started = 0;
+  block_t *blocks, *b;
+  int in_str = 0, escape = 0;
+  long depth = 0;
+  chunk_t *r;
+
+  num_blocks = (len + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+  /* allocate chunks (one more than necessary, so there's always one) */
+  if ((r = calloc(num_blocks + 1, sizeof(chunk_t))) == NULL)
+    return NULL;
+
+  /* allocate block results and thread arguments */
+  blocks = malloc(2 * num_blocks * sizeof(block_t) + 1);
+  args = malloc(num_threads * sizeof(classify_args_t));
+  threads = malloc(num_threads * sizeof(pthread_t));
+  if (!blocks || !args || !threads) {
+    free(threads);
+    free(args);
+    free(blocks);
+    free(r);
+    return NULL;
+  }
+
+  /* phase one: classify blocks in parallel */
+  for (i = 0; i < num_threads; i++) {
+    args[i].buf = buf;
+    args[i].len = len;
+    args[i].blocks = blocks;
+    args[i].num_blocks = num_blocks;
+    args[i].thread = i;
+    args[i].num_threads = num_threads;
+
+    /* classify blocks here if the thread can't be started */
+    if (!pthread_create(threads + num_started, NULL, classify_blocks, args + i))
+      num_started++;
+    else
+      classify_blocks(args + i);
+  }
+
+  for (i = 0; i < num_started; i++)
+    pthread_join(threads[i], NULL);
+
+  /* phase two: find split points */
+  for (i = 0, n = 0, ofs = 0; i < num_blocks; i++) {
+    /* look for root-level comma in block (except the first) */
+    end = ((i + 1) * CHUNK_SIZE < len) ? (i + 1) * CHUNK_SIZE : len;
+    if (i > 0 && (end = find_split(buf, i * CHUNK_SIZE, end, in_str, escape, depth)) > 0) {
+      /* end current chunk after comma */
+      r[n].ofs = ofs;
+      r[n].len = end - ofs;
+      ofs = end;
+      n++;
+    }
+
+    /* advance to start of next block */
+    b = blocks + 2 * i + escape;
+    depth += b->delta[in_str];
+    in_str ^= b->parity;
+    escape = b->escape;
+  }
+
+  /* last chunk */
+  r[n].ofs = ofs;
+  r[n].len = len - ofs;
+  *num_chunks = len ? n + 1 : 0;
+
+  free(threads);
+  free(args);
+  free(blocks);
+
+  /* return chunks */
+  return r;
+}
+
+/*
+ * add_tokens() - Append the tokens in a batch to a chunk, copying any
+ * values in the batch data to the chunk data.
+ */
+static jf_err_t
+add_tokens(chunk_t *c, jf_batch_t *b) {
+  jf_token_t *t;
+  size_t i, n;
+
+  /* grow token array */
+  if (c->num_tokens + b->num_tokens > c->max_tokens) {
+    for (n = c->max_tokens ? c->max_tokens : MIN_TOKENS; n < c->num_tokens + b->num_tokens; n *= 2);
+
+    if ((t = realloc(c->tokens, n * sizeof(jf_token_t))) == NULL)
+      return JF_ERR_OUT_OF_MEMORY;
+
+    c->tokens = t;
+    c->max_tokens = n;
+  }
+
+  /* copy batch data */
+  memcpy(c->data + c->data_len, b->data, b->data_len);
+
+  for (i = 0; i < b->num_tokens; i++) {
+    t = c->tokens + c->num_tokens++;
+    *t = b->tokens[i];
+
+    /* point copied values at chunk data */
+    if (t->val >= b->data && t->val < b->data + b->data_len)
+      t->val = c->data + c->data_len + (t->val - b->data);
+  }
+
+  c->data_len += b->data_len;
+
+  /* return success */
+  return JF_OK;
+}
+
+/*
+ * parse_batch() - Parse the given data into a batch, and append the
+ * tokens to the chunk (even if there was an error, so that the tokens
+ * before an error are delivered too).
+ */
+static jf_err_t
+parse_batch(chunk_t *c, jf_t *p, jf_batch_t *b, const uint8_t *buf, size_t len, size_t *num_read) {
+  jf_err_t err, add_err;
+
+  err = jf_parse_batch(p, b, buf, len, num_read);
+  add_err = add_tokens(c, b);
+
+  /* return result */
+  return (err != JF_OK) ? err : add_err;
+}
+
+/*
+ * parse_chunk() - Parse a chunk into its token array.
+ */
+static void
+parse_chunk(pool_t *pool, chunk_t *c) {
+  jf_token_t tokens[BATCH_SIZE];
+  uint8_t data[JF_BATCH_DATA_SIZE(BATCH_SIZE)];
+  const uint8_t *buf = pool->buf + c->ofs;
+  size_t ofs, num_read;
+  jf_batch_t b;
+  jf_err_t err = JF_OK;
+  jf_t *p;
+
+  /* 
+   * keep parser until the next chunk is delivered, so its final state
+   * can be checked (see deliver_chunk())
+   */
+  if ((c->p = malloc(sizeof(parser_t))) == NULL) {
+    c->err = JF_ERR_OUT_OF_MEMORY;
+    c->end_ofs = c->ofs;
+    return;
+  }
+
+  /* init parser; token offsets are relative to the whole input */
+  p = &(c->p->parser);
+  jf_init(p, NULL);
+  p->flags = pool->flags;
+  jf_set_keymap(p, pool->keymap, &(c->p->key_buf));
+  p->num_bytes = c->ofs;
+
+  if (pool->root && c->ofs > 0) {
+    /* 
+     * this chunk starts just after a comma in the root container, so
+     * start parser in that state (this is checked when the chunk is
+     * delivered)
+     */
+    p->top = pool->top;
+    p->stack[0] = (pool->root == 'o') ? 1 : 0;
+    p->depth = 1;
+    p->state = pool->root;
+  }
+
+  /* init batch */
+  b.tokens = tokens;
+  b.max_tokens = BATCH_SIZE;
+  b.data = data;
+  b.data_size = sizeof(data);
+
+  /* 
+   * allocate chunk data: the parser only copies escaped strings and 
+   * numbers, which are never longer than their input
+   */
+  if ((c->data = malloc(c->len + 1)) == NULL)
+    err = JF_ERR_OUT_OF_MEMORY;
+
+  /* parse chunk as a series of batches */
+  for (ofs = 0; err == JF_OK && ofs < c->len; ofs += num_read)
+    err = parse_batch(c, p, &b, buf + ofs, c->len - ofs, &num_read);
+
+  /* 
+   * finish parsing (through the batch, to get any trailing number);
+   * only the last chunk is complete
+   */
+  if (err == JF_OK && c == pool->chunks + pool->num_chunks - 1)
+    err = parse_batch(c, p, &b, NULL, 0, &num_read);
+
+  /* save result */
+  c->err = err;
+  c->end_ofs = p->num_bytes;
+}
+
+/*
+ * free_chunk() - Free the tokens, data, and parser of a chunk.
+ */
+static void
+free_chunk(chunk_t *c) {
+  free(c->tokens);
+  free(c->data);
+  free(c->p);
+
+  c->tokens = NULL;
+  c->data = NULL;
+  c->p = NULL;
+}
+
+/*
+ * send_token() - Pass a token to the caller's parser callback, unless
+ * it is part of a value the callback skipped.
+ *
+ * Note: The tokens were parsed already, so skipped values are skipped
+ * token by token, following the same rules as skip_value() in jiffy.c.
+ * Keys are never skipped, and a JF_SKIP from the end of a key skips
+ * the member value, whether it is sent as JF_TYPE_END_KEY or (without
+ * JF_FLAG_KEY_TOKENS) as JF_TYPE_END_STRING.
+ */
+static jf_err_t
+send_token(pool_t *pool, jf_type_t type, const uint8_t *val, size_t len) {
+  jf_t *p = pool->parser;
+  jf_type_t cb_type = type;
+  jf_err_t err;
+
+  /* skip member value */
+  if (pool->skip_next) {
+    pool->skip_next = 0;
+
+    if (type == JF_TYPE_BGN_OBJECT || type == JF_TYPE_BGN_ARRAY || type == JF_TYPE_BGN_STRING)
+      pool->skip = 1;
+
+    return JF_OK;
+  }
+
+  /* skip tokens up to the end of the skipped value */
+  if (pool->skip) {
+    switch (type) {
+    case JF_TYPE_BGN_OBJECT:
+    case JF_TYPE_BGN_ARRAY:
+    case JF_TYPE_BGN_STRING:
+    case JF_TYPE_BGN_KEY:
+      pool->skip++;
+      break;
+    case JF_TYPE_END_OBJECT:
+    case JF_TYPE_END_ARRAY:
+    case JF_TYPE_END_STRING:
+    case JF_TYPE_END_KEY:
+      pool->skip--;
+      break;
+    default:
+      break;
+    }
+
+    return JF_OK;
+  }
+
+  if (!p->cb)
+    return JF_OK;
+
+  /* send key tokens as string tokens, unless the caller wants them */
+  if (pool->key_strings) {
+    switch (type) {
+    case JF_TYPE_BGN_KEY:
+      cb_type = JF_TYPE_BGN_STRING;
+      break;
+    case JF_TYPE_KEY_FRAGMENT:
+      cb_type = JF_TYPE_STRING_FRAGMENT;
+      break;
+    case JF_TYPE_END_KEY:
+      cb_type = JF_TYPE_END_STRING;
+      break;
+    default:
+      break;
+    }
+  }
+
+  if ((err = p->cb(p, cb_type, val, len)) != JF_SKIP)
+    return err;
+
+  /* start skipping value (by the original type, so keys aren't) */
+  switch (type) {
+  case JF_TYPE_BGN_OBJECT:
+  case JF_TYPE_BGN_ARRAY:
+  case JF_TYPE_BGN_STRING:
+    pool->skip = 1;
+    break;
+  case JF_TYPE_END_KEY:
+    pool->skip_next = 1;
+    break;
+  default:
+    break;
+  }
+
+  /* return success */
+  return JF_OK;
+}
+
+/*
+ * forward_cb() - Pass tokens from an internal parser to the caller's
+ * parser callback.
+ */
+static jf_err_t
+forward_cb(jf_t *q, jf_type_t type, const uint8_t *val, const size_t len) {
+  pool_t *pool = (pool_t*) q->user_data;
+  jf_t *p = pool->parser;
+
+  p->num_bytes = q->num_bytes;
+  p->num = q->num;
+  if (!pool->key_strings) {
+    p->key_hash = q->key_hash;
+    p->key_id = q->key_id;
+  }
+
+  return send_token(pool, type, val, len);
+}
+
+/*
+ * finish_serial() - Parse the rest of the input from the given offset
+ * with the given internal parser, passing the tokens to the caller's
+ * parser callback.  Used if a chunk didn't start in the expected
+ * state.
+ */
+static jf_err_t
+finish_serial(jf_t *p, jf_t *q, pool_t *pool, size_t ofs) {
+  jf_err_t err;
+
+  /* forward tokens to caller's callback */
+  q->cb = forward_cb;
+  q->user_data = pool;
+  q->flags |= JF_FLAG_ZERO_COPY;
+
+  /* parse rest of document */
+  if ((err = jf_parse(q, pool->buf + ofs, pool->len - ofs)) == JF_OK)
+    err = jf_done(q);
+
+  /* save final offset */
+  p->num_bytes = q->num_bytes;
+
+  /* return result */
+  return err;
+}
+
+/*
+ * deliver_chunk() - Send the tokens in a parsed chunk to the parser
+ * callback.  Sets done if the rest of the input was handled too.
+ */
+static jf_err_t
+deliver_chunk(jf_t *p, pool_t *pool, chunk_t *c, int *done) {
+  chunk_t *prev = (c > pool->chunks) ? c - 1 : NULL;
+  jf_token_t *t;
+  jf_err_t err;
+  size_t i;
+
+  /* 
+   * make sure the previous chunk ended in the state this chunk started
+   * in (just inside the root container of a single document, or 
+   * between records); if not, then parse the rest serially
+   */
+  if (prev && (prev->p->parser.state != pool->root || prev->p->parser.depth != (pool->root ? 1 : 0))) {
+    *done = 1;
+    return finish_serial(p, &(prev->p->parser), pool, c->ofs);
+  }
+
+  for (i = 0; i < c->num_tokens; i++) {
+    t = c->tokens + i;
+
+    /* set parser fields for callback */
+    p->num_bytes = t->ofs;
+    if (t->type == JF_TYPE_INTEGER || t->type == JF_TYPE_FLOAT) {
+      p->num = t->num;
+    } else if (t->type == JF_TYPE_END_KEY && !pool->key_strings) {
+      p->key_hash = t->key_hash;
+      p->key_id = t->key_id;
+    }
+
+    if ((err = send_token(pool, t->type, t->val, t->len)) != JF_OK)
+      return err;
+  }
+
+  /* save offset of error or end of chunk */
+  p->num_bytes = c->end_ofs;
+
+  /* return chunk result */
+  return c->err;
+}
+
+/*
+ * worker() - Worker thread: parse chunks in order until there are none
+ * left or the pool is stopped.
+ */
+static void *
+worker(void *arg) {
+  pool_t *pool = (pool_t*) arg;
+  chunk_t *c;
+
+  pthread_mutex_lock(&(pool->mutex));
+
+  for (;;) {
+    /* wait until the next chunk is inside the delivery window */
+    while (!pool->stop && pool->next_chunk < pool->num_chunks &&
+           pool->next_chunk >= pool->next_deliver + pool->window)
+      pthread_cond_wait(&(pool->work_cv), &(pool->mutex));
+
+    if (pool->stop || pool->next_chunk >= pool->num_chunks)
+      break;
+
+    /* claim next chunk */
+    c = pool->chunks + pool->next_chunk++;
+
+    /* parse chunk without holding lock */
+    pthread_mutex_unlock(&(pool->mutex));
+    parse_chunk(pool, c);
+    pthread_mutex_lock(&(pool->mutex));
+
+    /* mark chunk as done */
+    c->done = 1;
+    pthread_cond_broadcast(&(pool->done_cv));
+  }
+
+  pthread_mutex_unlock(&(pool->mutex));
+
+  return NULL;
+}
+
+/*
+ * run_pool() - Parse the chunks in a pool on the given number of
+ * threads, and deliver them to the parser callback in order.
+ */
+static jf_err_t
+run_pool(jf_t *p, pool_t *pool, size_t num_threads) {
+  pthread_t *threads;
+  size_t i, num_started = 0;
+  jf_err_t err = JF_OK;
+  int done = 0;
+  chunk_t *c;
+
+  pool->window = CHUNKS_PER_THREAD * num_threads;
+
+  pthread_mutex_init(&(pool->mutex), NULL);
+  pthread_cond_init(&(pool->work_cv), NULL);
+  pthread_cond_init(&(pool->done_cv), NULL);
+
+  /* 
+   * start workers (if a thread can't be started, then the calling 
+   * thread picks up the slack below)
+   */
+  if ((threads = malloc(num_threads * sizeof(pthread_t))) != NULL) {
+    for (i = 0; i < num_threads; i++)
+      if (!pthread_create(threads + num_started, NULL, worker, pool))
+        num_started++;
+  }
+
+  pthread_mutex_lock(&(pool->mutex));
+
+  while (err == JF_OK && !done && pool->next_deliver < pool->num_chunks) {
+    c = pool->chunks + pool->next_deliver;
+
+    if (pool->next_chunk == pool->next_deliver) {
+      /* nobody has claimed this chunk yet, so parse it here */
+      pool->next_chunk++;
+
+      pthread_mutex_unlock(&(pool->mutex));
+      parse_chunk(pool, c);
+      pthread_mutex_lock(&(pool->mutex));
+
+      c->done = 1;
+    }
+
+    /* wait for chunk */
+    while (!c->done)
+      pthread_cond_wait(&(pool->done_cv), &(pool->mutex));
+
+    /* deliver chunk without holding lock */
+    pthread_mutex_unlock(&(pool->mutex));
+    err = deliver_chunk(p, pool, c, &done);
+
+    /* free previous chunk (this chunk's parser is still needed) */
+    if (c > pool->chunks)
+      free_chunk(c - 1);
+
+    pthread_mutex_lock(&(pool->mutex));
+
+    /* move delivery window */
+    pool->next_deliver++;
+    pthread_cond_broadcast(&(pool->work_cv));
+  }
+
+  /* stop workers */
+  pool->stop = 1;
+  pthread_cond_broadcast(&(pool->work_cv));
+  pthread_mutex_unlock(&(pool->mutex));
+
+  for (i = 0; i < num_started; i++)
+    pthread_join(threads[i], NULL);
+
+  /* free remaining chunks */
+  for (i = (pool->next_deliver ? pool->next_deliver - 1 : 0); i < pool->num_chunks; i++)
+    free_chunk(pool->chunks + i);
+
+  free(threads);
+  pthread_cond_destroy(&(pool->done_cv));
+  pthread_cond_destroy(&(pool->work_cv));
+  pthread_mutex_destroy(&(pool->mutex));
+
+  /* return result */
+  return err;
+}
+
+/*
+ * init_pool() - Initialize a worker pool.
+ */
+static void
+init_pool(pool_t *pool, jf_t *p, const uint8_t *buf, size_t len) {
+  memset(pool, 0, sizeof(pool_t));
+  pool->buf = buf;
+  pool->len = len;
+  pool->flags = (p->flags & (JF_FLAG_IGNORE_RFC3629 | JF_FLAG_CONVERT_NUMBERS)) | JF_FLAG_KEY_TOKENS;
+  pool->keymap = p->keymap;
+  pool->parser = p;
+  pool->key_strings = !(p->flags & JF_FLAG_KEY_TOKENS);
+}
+
+jf_err_t
+jf_parse_ndjson_mt(jf_t *p, const uint8_t *buf, size_t len, size_t num_threads) {
+  jf_err_t err;
+  pool_t pool;
+
+  if (!num_threads)
+    num_threads = 1;
+
+  /* init pool */
+  init_pool(&pool, p, buf, len);
+  pool.flags |= JF_FLAG_NDJSON;
+
+  /* split input at newlines */
+  if ((pool.chunks = split_lines(buf, len, &(pool.num_chunks))) == NULL)
+    return JF_ERR_OUT_OF_MEMORY;
+
+  /* parse chunks */
+  err = run_pool(p, &pool, num_threads);
+
+  /* free chunks */
+  free(pool.chunks);
+
+  /* return result */
+  return err;
+}
+
+/*
+ * IS_SPACE() - Is the given byte whitespace (see jiffy.c)?
+ */
+#define IS_SPACE(c) ((c) == ' ' || ((c) >= '\b' && (c) <= '\r'))
+
+jf_err_t
+jf_parse_mt(jf_t *p, const uint8_t *buf, size_t len, size_t num_threads) {
+  size_t i = 0;
+  jf_err_t err;
+  pool_t pool;
+
+  if (!num_threads)
+    num_threads = 1;
+
+  /* init pool */
+  init_pool(&pool, p, buf, len);
+
+  /* find root container, skipping whitespace and an opening paren */
+  pool.top = ' ';
+  while (i < len && IS_SPACE(buf[i]))
+    i++;
+  if (i < len && buf[i] == '(') {
+    pool.top = 'f';
+    for (i++; i < len && IS_SPACE(buf[i]); i++);
+  }
+
+  if (i < len && (buf[i] == '[' || buf[i] == '{')) {
+    /* split document at commas in root container */
+    pool.root = (buf[i] == '[') ? 'a' : 'o';
+    pool.chunks = split_document(buf, len, num_threads, &(pool.num_chunks));
+  } else {
+    /* not a container, so parse document as one chunk */
+    if ((pool.chunks = calloc(1, sizeof(chunk_t))) != NULL) {
+      pool.chunks[0].len = len;
+      pool.num_chunks = 1;
+    }
+  }
+
+  if (!pool.chunks)
+    return JF_ERR_OUT_OF_MEMORY;
+
+  /* parse chunks */
+  err = run_pool(p, &pool, num_threads);
+
+  /* free chunks */
+  free(pool.chunks);
+
+  /* return result */
+  return err;
+}
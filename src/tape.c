@@ -0,0 +1,317 @@
+/*
+ * Jiffy - Fast, lighweight, and reentrant JSON stream parser.
+ *
+ * Copyright (C) 2009 Paul Duncan <pabs@pablotron.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdlib.h> /* for realloc(), free() */
+#include <string.h> /* for memset(), memcpy(), memcmp() */
+#include <jiffy/tape.h>
+
+/* number of tokens per batch in jf_tape_load() */
+#define LOAD_BATCH_SIZE 256
+
+/* initial sizes of growable arrays */
+#define MIN_TAPE_SIZE     64
+#define MIN_STRINGS_SIZE  256
+#define MIN_OPEN_SIZE     16
+
+#define ENTRY(type, payload) ((((uint64_t) (type)) << 56) | (uint64_t) (payload))
+
+/*
+ * grow() - Make sure the given array has room for at least num_new
+ * more elements, doubling its size as necessary.
+ */
+static jf_err_t
+grow(void **ary, size_t *size, const size_t len, const size_t num_new, const size_t elem_size, const size_t min_size) {
+  size_t new_size = *size ? *size : min_size;
+  void *new_ary;
+
+  /* check for room */
+  if (len + num_new <= *size)
+    return JF_OK;
+
+  /* double size until there's room */
+  while (new_size < len + num_new)
+    new_size *= 2;
+
+  /* reallocate array */
+  if ((new_ary = realloc(*ary, new_size * elem_size)) == NULL)
+    return JF_ERR_OUT_OF_MEMORY;
+
+  /* save new array */
+  *ary = new_ary;
+  *size = new_size;
+
+  /* return success */
+  return JF_OK;
+}
+
+#define GROW_TAPE(t, n) grow(                       \
+  (void**) &((t)->tape), &((t)->tape_size),         \
+  (t)->tape_len, (n), sizeof(uint64_t),             \
+  MIN_TAPE_SIZE                                     \
+)
+
+#define GROW_STRINGS(t, n) grow(                    \
+  (void**) &((t)->strings), &((t)->strings_size),   \
+  (t)->strings_len, (n), 1, MIN_STRINGS_SIZE        \
+)
+
+#define GROW_OPEN(t) grow(                          \
+  (void**) &((t)->open), &((t)->open_size),         \
+  (t)->open_len, 1, sizeof(size_t), MIN_OPEN_SIZE   \
+)
+
+/*
+ * tape_token() - Append a token to the tape.
+ */
+static jf_err_t
+tape_token(jf_tape_t *t, jf_type_t type, const uint8_t *val, const size_t len, const jf_num_t *num) {
+  jf_err_t err;
+  size_t bgn;
+
+  switch (type) {
+  case JF_TYPE_BGN_OBJECT:
+  case JF_TYPE_BGN_ARRAY:
+    if ((err = GROW_TAPE(t, 1)) != JF_OK || (err = GROW_OPEN(t)) != JF_OK)
+      return err;
+
+    /* remember begin entry; payload is filled in at the end */
+    t->open[t->open_len++] = t->tape_len;
+    t->tape[t->tape_len++] = ENTRY((type == JF_TYPE_BGN_OBJECT) ? JF_TAPE_OBJECT : JF_TAPE_ARRAY, 0);
+
+    break;
+  case JF_TYPE_END_OBJECT:
+  case JF_TYPE_END_ARRAY:
+    if ((err = GROW_TAPE(t, 1)) != JF_OK)
+      return err;
+
+    /* link begin and end entries */
+    bgn = t->open[--t->open_len];
+    t->tape[bgn] |= (uint64_t) (t->tape_len + 1);
+    t->tape[t->tape_len++] = ENTRY((type == JF_TYPE_END_OBJECT) ? JF_TAPE_END_OBJECT : JF_TAPE_END_ARRAY, bgn);
+
+    break;
+  case JF_TYPE_BGN_STRING:
+    /* remember where string starts in arena */
+    t->str_ofs = t->strings_len;
+
+    break;
+  case JF_TYPE_STRING_FRAGMENT:
+    if ((err = GROW_STRINGS(t, len)) != JF_OK)
+      return err;
+
+    /* append fragment to arena */
+    memcpy(t->strings + t->strings_len, val, len);
+    t->strings_len += len;
+
+    break;
+  case JF_TYPE_END_STRING:
+    if ((err = GROW_STRINGS(t, 1)) != JF_OK || (err = GROW_TAPE(t, 2)) != JF_OK)
+      return err;
+
+    /* null-terminate string */
+    t->strings[t->strings_len++] = '\0';
+
+    /* add string and length entries */
+    t->tape[t->tape_len++] = ENTRY(JF_TAPE_STRING, t->str_ofs);
+    t->tape[t->tape_len++] = t->strings_len - 1 - t->str_ofs;
+
+    break;
+  case JF_TYPE_INTEGER:
+  case JF_TYPE_FLOAT:
+    if ((err = GROW_TAPE(t, 2)) != JF_OK)
+      return err;
+
+    if (type == JF_TYPE_INTEGER && !(num->flags & JF_NUM_OVERFLOW)) {
+      t->tape[t->tape_len++] = ENTRY(JF_TAPE_INTEGER, 0);
+      t->tape[t->tape_len++] = (uint64_t) num->i;
+    } else {
+      /* store floats and out-of-range integers as doubles */
+      t->tape[t->tape_len++] = ENTRY(JF_TAPE_FLOAT, 0);
+      memcpy(t->tape + t->tape_len++, &(num->d), sizeof(double));
+    }
+
+    break;
+  case JF_TYPE_TRUE:
+  case JF_TYPE_FALSE:
+  case JF_TYPE_NULL:
+    if ((err = GROW_TAPE(t, 1)) != JF_OK)
+      return err;
+
+    t->tape[t->tape_len++] = ENTRY(
+      (type == JF_TYPE_TRUE) ? JF_TAPE_TRUE :
+      (type == JF_TYPE_FALSE) ? JF_TAPE_FALSE : JF_TAPE_NULL, 0
+    );
+
+    break;
+  default:
+    /* ignore other tokens */
+    break;
+  }
+
+  /* return success */
+  return JF_OK;
+}
+
+static jf_err_t
+tape_cb(jf_t *p, jf_type_t type, const uint8_t *val, const size_t len) {
+  return tape_token((jf_tape_t*) p->user_data, type, val, len, &(p->num));
+}
+
+void
+jf_tape_init(jf_tape_t *t, jf_t *p) {
+  memset(t, 0, sizeof(jf_tape_t));
+
+  /* bind parser to tape */
+  jf_init(p, tape_cb);
+  p->user_data = t;
+  p->flags = JF_FLAG_ZERO_COPY | JF_FLAG_CONVERT_NUMBERS;
+}
+
+jf_err_t
+jf_tape_load(jf_tape_t *t, const uint8_t *buf, size_t len) {
+  jf_token_t tokens[LOAD_BATCH_SIZE];
+  uint8_t data[JF_BATCH_DATA_SIZE(LOAD_BATCH_SIZE)];
+  jf_batch_t batch;
+  size_t i, ofs, num_read;
+  jf_err_t err;
+  jf_t p;
+
+  /* init tape and parser */
+  jf_tape_init(t, &p);
+
+  /* init batch */
+  batch.tokens = tokens;
+  batch.max_tokens = LOAD_BATCH_SIZE;
+  batch.data = data;
+  batch.data_size = sizeof(data);
+
+  /* parse document as a series of batches */
+  for (ofs = 0; ofs < len; ofs += num_read) {
+    if ((err = jf_parse_batch(&p, &batch, buf + ofs, len - ofs, &num_read)) != JF_OK)
+      return err;
+
+    /* add tokens to tape */
+    for (i = 0; i < batch.num_tokens; i++) {
+      err = tape_token(
+        t, batch.tokens[i].type,
+        batch.tokens[i].val, batch.tokens[i].len,
+        &(batch.tokens[i].num)
+      );
+
+      if (err != JF_OK)
+        return err;
+    }
+  }
+
+  /* finish parsing */
+  return jf_done(&p);
+}
+
+void
+jf_tape_free(jf_tape_t *t) {
+  free(t->tape);
+  free(t->strings);
+  free(t->open);
+  memset(t, 0, sizeof(jf_tape_t));
+}
+
+jf_tape_type_t
+jf_tape_type(const jf_tape_t *t, size_t i) {
+  return JF_TAPE_ENTRY_TYPE(t->tape[i]);
+}
+
+size_t
+jf_tape_next(const jf_tape_t *t, size_t i) {
+  switch (JF_TAPE_ENTRY_TYPE(t->tape[i])) {
+  case JF_TAPE_OBJECT:
+  case JF_TAPE_ARRAY:
+    /* begin entry points past matching end entry */
+    return (size_t) JF_TAPE_ENTRY_PAYLOAD(t->tape[i]);
+  case JF_TAPE_STRING:
+  case JF_TAPE_INTEGER:
+  case JF_TAPE_FLOAT:
+    /* two-entry values */
+    return i + 2;
+  default:
+    return i + 1;
+  }
+}
+
+size_t
+jf_tape_find(const jf_tape_t *t, size_t i, const uint8_t *key, size_t key_len) {
+  if (JF_TAPE_ENTRY_TYPE(t->tape[i]) != JF_TAPE_OBJECT)
+    return JF_TAPE_NONE;
+
+  /* walk members, skipping values */
+  for (i++; JF_TAPE_ENTRY_TYPE(t->tape[i]) != JF_TAPE_END_OBJECT; i = jf_tape_next(t, i + 2)) {
+    if (t->tape[i + 1] == key_len && !memcmp(t->strings + JF_TAPE_ENTRY_PAYLOAD(t->tape[i]), key, key_len))
+      return i + 2;
+  }
+
+  /* return failure */
+  return JF_TAPE_NONE;
+}
+
+size_t
+jf_tape_at(const jf_tape_t *t, size_t i, size_t n) {
+  if (JF_TAPE_ENTRY_TYPE(t->tape[i]) != JF_TAPE_ARRAY)
+    return JF_TAPE_NONE;
+
+  /* walk elements, skipping values */
+  for (i++; JF_TAPE_ENTRY_TYPE(t->tape[i]) != JF_TAPE_END_ARRAY; i = jf_tape_next(t, i)) {
+    if (!n--)
+      return i;
+  }
+
+  /* return failure */
+  return JF_TAPE_NONE;
+}
+
+const uint8_t *
+jf_tape_string(const jf_tape_t *t, size_t i, size_t *len) {
+  if (len)
+    *len = (size_t) t->tape[i + 1];
+
+  return t->strings + JF_TAPE_ENTRY_PAYLOAD(t->tape[i]);
+}
+
+int64_t
+jf_tape_int(const jf_tape_t *t, size_t i) {
+  return (int64_t) t->tape[i + 1];
+}
+
+double
+jf_tape_float(const jf_tape_t *t, size_t i) {
+  double r;
+
+  if (JF_TAPE_ENTRY_TYPE(t->tape[i]) == JF_TAPE_INTEGER)
+    return (double) (int64_t) t->tape[i + 1];
+
+  memcpy(&r, t->tape + i + 1, sizeof(double));
+  return r;
+}
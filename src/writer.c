@@ -0,0 +1,728 @@
+/*
+ * Jiffy - Fast, lighweight, and reentrant JSON stream parser.
+ *
+ * Copyright (C) 2009 Paul Duncan <pabs@pablotron.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdio.h> /* for sprintf() */
+#include <stdlib.h> /* for realloc(), free(), strtod() */
+#include <string.h> /* for memset(), memcpy() */
+#include <jiffy/writer.h>
+
+/*
+ * Use SSE2 to scan strings for characters which need escaping, if the
+ * compiler supports it (see the matching check in jiffy.c).
+ */
+#if defined(__SSE2__) && !defined(JF_NO_SIMD)
+#define JF_USE_SSE2 1
+#include <emmintrin.h> /* for SSE2 intrinsics */
+#endif /* __SSE2__ && !JF_NO_SIMD */
+
+/* initial size of growable buffer */
+#define MIN_BUF_SIZE 256
+
+/*
+ * Container stack macros (see jiffy.c).  The bit for each level of
+ * nesting is set for objects and clear for arrays.
+ */
+#define STACK_BIT(d) (1 << ((d) & 7))
+
+#define IN_OBJECT(w)                                \
+  ((w)->stack[((w)->depth - 1) >> 3] &              \
+   STACK_BIT((w)->depth - 1))
+
+/*
+ * Escape character for each byte: the character written after the
+ * backslash, 'u' for bytes written as \u00XX, or 0 for bytes which
+ * are copied as-is.
+ */
+static const uint8_t
+escapes[256] = {
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+  'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+  0,   0,   '"', 0,   0,   0,   0,   0,
+  0,   0,   0,   0,   0,   0,   0,   0,
+  0,   0,   0,   0,   0,   0,   0,   0,
+  0,   0,   0,   0,   0,   0,   0,   0,
+  0,   0,   0,   0,   0,   0,   0,   0,
+  0,   0,   0,   0,   0,   0,   0,   0,
+  0,   0,   0,   0,   0,   0,   0,   0,
+  0,   0,   0,   0,   '\\', 0,  0,   0,
+};
+
+static const char
+hex_digits[] = "0123456789abcdef";
+
+/* two-digit decimal strings, from "00" to "99" */
+static const char
+digit_pairs[] =
+  "0001020304050607080910111213141516171819"
+  "2021222324252627282930313233343536373839"
+  "4041424344454647484950515253545556575859"
+  "6061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+/* powers of ten which are exactly representable as doubles */
+static const double
+exact_pow10[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+  1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+/* largest number of decimal places tried by format_double() */
+#define MAX_FAST_PLACES 15
+
+/* range of decimal exponents written in fixed form by format_digits() */
+#define MIN_FIXED_EXP -4
+#define MAX_FIXED_EXP 15
+
+/*
+ * reserve() - Make room for n more bytes in the buffer, either by
+ * growing it or by flushing it.  When flushing, n must be at most
+ * JF_WRITER_MIN_BUF_LEN.
+ */
+static jf_err_t
+reserve(jf_writer_t *w, const size_t n) {
+  size_t new_size;
+  uint8_t *new_buf;
+
+  /* check for room */
+  if (w->buf_len + n <= w->buf_size)
+    return JF_OK;
+
+  /* caller-supplied buffer: pass it to the flush callback */
+  if (w->cb)
+    return jf_writer_flush(w);
+
+  /* double size until there's room */
+  new_size = w->buf_size ? w->buf_size : MIN_BUF_SIZE;
+  while (new_size < w->buf_len + n)
+    new_size *= 2;
+
+  /* reallocate buffer */
+  if ((new_buf = realloc(w->buf, new_size)) == NULL)
+    return JF_ERR_OUT_OF_MEMORY;
+
+  /* save new buffer */
+  w->buf = new_buf;
+  w->buf_size = new_size;
+
+  /* return success */
+  return JF_OK;
+}
+
+#define RESERVE(w, n) do {                          \
+  if ((w)->buf_len + (n) > (w)->buf_size &&         \
+      (err = reserve((w), (n))) != JF_OK)           \
+    return err;                                     \
+} while (0)
+
+/*
+ * write_bytes() - Append any number of bytes to the buffer, flushing
+ * it as many times as necessary.
+ */
+static jf_err_t
+write_bytes(jf_writer_t *w, const uint8_t *src, size_t len) {
+  size_t n;
+  jf_err_t err;
+
+  /* growable buffer: copy everything at once */
+  if (!w->cb) {
+    RESERVE(w, len);
+    memcpy(w->buf + w->buf_len, src, len);
+    w->buf_len += len;
+
+    /* return success */
+    return JF_OK;
+  }
+
+  for (;;) {
+    /* copy as much as fits */
+    n = w->buf_size - w->buf_len;
+    if (n > len)
+      n = len;
+
+    memcpy(w->buf + w->buf_len, src, n);
+    w->buf_len += n;
+    src += n;
+    len -= n;
+
+    if (!len)
+      return JF_OK;
+
+    /* buffer is full, flush it */
+    if ((err = jf_writer_flush(w)) != JF_OK)
+      return err;
+  }
+}
+
+#ifdef JF_USE_SSE2
+/*
+ * first_bit() - Get the index of the lowest set bit in a non-zero 
+ * movemask result.
+ */
+static size_t
+first_bit(int mask) {
+#ifdef __GNUC__
+  return __builtin_ctz(mask);
+#else
+  size_t r = 0;
+
+  while (!(mask & 1)) {
+    mask >>= 1;
+    r++;
+  }
+
+  return r;
+#endif /* __GNUC__ */
+}
+#endif /* JF_USE_SSE2 */
+
+/*
+ * scan_escape() - Return the offset of the first byte in buf at or
+ * after offset i which needs escaping, or len if there isn't one.
+ */
+static size_t
+scan_escape(const uint8_t *buf, size_t i, const size_t len) {
+#ifdef JF_USE_SSE2
+  const __m128i quote = _mm_set1_epi8('"'),
+                slash = _mm_set1_epi8('\\'),
+                ctrl = _mm_set1_epi8(0x1f);
+  __m128i v, d;
+  int mask;
+
+  /* check 16 bytes at a time for quotes, backslashes, and bytes <= 0x1f */
+  for (; i + 16 <= len; i += 16) {
+    v = _mm_loadu_si128((const __m128i*) (buf + i));
+    d = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash)),
+      _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v)
+    );
+
+    if ((mask = _mm_movemask_epi8(d)) != 0)
+      return i + first_bit(mask);
+  }
+#endif /* JF_USE_SSE2 */
+
+  /* check remaining bytes */
+  while (i < len && !escapes[buf[i]])
+    i++;
+
+  /* return offset of first byte which needs escaping, or len */
+  return i;
+}
+
+/*
+ * write_string() - Write a quoted and escaped string.
+ */
+static jf_err_t
+write_string(jf_writer_t *w, const uint8_t *str, const size_t len) {
+  size_t i = 0, j;
+  uint8_t c;
+  jf_err_t err;
+
+  /* write opening quote */
+  RESERVE(w, 1);
+  w->buf[w->buf_len++] = '"';
+
+  for (;;) {
+    /* copy run of bytes which don't need escaping */
+    j = scan_escape(str, i, len);
+    if (j > i && (err = write_bytes(w, str + i, j - i)) != JF_OK)
+      return err;
+
+    if (j == len)
+      break;
+
+    /* write escape */
+    RESERVE(w, 6);
+    c = escapes[str[j]];
+    w->buf[w->buf_len++] = '\\';
+    w->buf[w->buf_len++] = c;
+
+    if (c == 'u') {
+      w->buf[w->buf_len++] = '0';
+      w->buf[w->buf_len++] = '0';
+      w->buf[w->buf_len++] = hex_digits[str[j] >> 4];
+      w->buf[w->buf_len++] = hex_digits[str[j] & 0xf];
+    }
+
+    i = j + 1;
+  }
+
+  /* write closing quote */
+  RESERVE(w, 1);
+  w->buf[w->buf_len++] = '"';
+
+  /* return success */
+  return JF_OK;
+}
+
+/*
+ * format_uint() - Write the decimal digits of v to dst, two digits at
+ * a time.  Returns the number of digits written (at most 20).
+ */
+static size_t
+format_uint(uint8_t *dst, uint64_t v) {
+  uint8_t tmp[20], *end = tmp + sizeof(tmp), *s = end;
+  size_t r;
+
+  /* write digit pairs from the end */
+  while (v >= 100) {
+    r = 2 * (v % 100);
+    v /= 100;
+    *--s = digit_pairs[r + 1];
+    *--s = digit_pairs[r];
+  }
+
+  /* write leading one or two digits */
+  if (v >= 10) {
+    *--s = digit_pairs[2 * v + 1];
+    *--s = digit_pairs[2 * v];
+  } else {
+    *--s = '0' + v;
+  }
+
+  /* copy digits to destination */
+  memcpy(dst, s, end - s);
+
+  /* return number of digits */
+  return end - s;
+}
+
+/*
+ * format_digits() - Write the significant digits of a number, with
+ * decimal exponent exp (the exponent of the first digit), to dst.
+ * Returns the length of the string.
+ *
+ * Note: Like Python's repr(), the fixed form is used when 1e-4 <= |d|
+ * < 1e16, and the exponent form otherwise, so neither very small nor
+ * very large values are padded with long runs of zeros.  Values
+ * written in the fixed form always have a decimal point (e.g. "1.0"),
+ * and values written in the exponent form always have an exponent, so
+ * they parse back as floats either way.
+ */
+static size_t
+format_digits(uint8_t *dst, const uint8_t *digits, size_t len, int exp) {
+  uint8_t tmp[20];
+  size_t n = 0, e;
+
+  if (exp >= MIN_FIXED_EXP && exp <= MAX_FIXED_EXP) {
+    if (exp < 0) {
+      /* pad fraction with leading zeros */
+      dst[n++] = '0';
+      dst[n++] = '.';
+      memset(dst + n, '0', -exp - 1);
+      n += -exp - 1;
+      memcpy(dst + n, digits, len);
+      n += len;
+    } else if (len > (size_t) exp + 1) {
+      /* insert decimal point */
+      memcpy(dst + n, digits, exp + 1);
+      n += exp + 1;
+      dst[n++] = '.';
+      memcpy(dst + n, digits + exp + 1, len - exp - 1);
+      n += len - exp - 1;
+    } else {
+      /* integral value: pad with trailing zeros, then add ".0" */
+      memcpy(dst + n, digits, len);
+      n += len;
+      memset(dst + n, '0', exp + 1 - len);
+      n += exp + 1 - len;
+      dst[n++] = '.';
+      dst[n++] = '0';
+    }
+  } else {
+    /* first digit, then decimal point and the rest (if any) */
+    dst[n++] = digits[0];
+    if (len > 1) {
+      dst[n++] = '.';
+      memcpy(dst + n, digits + 1, len - 1);
+      n += len - 1;
+    }
+
+    /* exponent, with a sign and at least two digits (e.g. "e-05") */
+    dst[n++] = 'e';
+    dst[n++] = (exp < 0) ? '-' : '+';
+    e = format_uint(tmp, (exp < 0) ? -exp : exp);
+    if (e < 2)
+      dst[n++] = '0';
+    memcpy(dst + n, tmp, e);
+    n += e;
+  }
+
+  /* return length */
+  return n;
+}
+
+/*
+ * format_double() - Write the shortest decimal string which parses
+ * back to d to dst (see format_digits()).  Returns the length of the
+ * string (at most JF_WRITER_MIN_BUF_LEN), or 0 if d is NaN or
+ * infinite.
+ *
+ * Note: This is the reverse of the fast path in convert_number() (see
+ * jiffy.c).  Most doubles have a short decimal form m / 10^k, with an
+ * integer m below 2^53, and then the division (double) m / 10^k is
+ * exact and shows whether the form parses back to d.  Anything else
+ * is formatted with sprintf() at increasing precisions.
+ */
+static size_t
+format_double(uint8_t *dst, double d) {
+  uint8_t digits[20];
+  char tmp[JF_WRITER_MIN_BUF_LEN], *s;
+  size_t k, n = 0, len, m_len;
+  uint64_t bits, m;
+  double x;
+  int prec;
+
+  /* reject NaN and infinity (maximum exponent) */
+  memcpy(&bits, &d, sizeof(bits));
+  if (((bits >> 52) & 0x7ff) == 0x7ff)
+    return 0;
+
+  /* write sign (including the sign of negative zero) */
+  if (bits >> 63) {
+    dst[n++] = '-';
+    d = -d;
+  }
+
+  /* fast path: find the fewest decimal places which parse back to d */
+  if (d < exact_pow10[MAX_FAST_PLACES]) {
+    for (k = 0; k <= MAX_FAST_PLACES; k++) {
+      x = d * exact_pow10[k];
+      if (x >= 9007199254740992.0)
+        break;
+
+      /* round to nearest integer and check it */
+      m = (uint64_t) (x + 0.5);
+      if ((double) m / exact_pow10[k] != d)
+        continue;
+
+      /* drop trailing zeros (d is m / 10^k, so exponent is from m) */
+      len = m_len = format_uint(digits, m);
+      while (len > 1 && digits[len - 1] == '0')
+        len--;
+
+      /* return length */
+      return n + format_digits(dst + n, digits, len, (int) m_len - (int) k - 1);
+    }
+  }
+
+  /*
+   * slow path: use the lowest precision which parses back to d
+   * (subnormals have fewer significant bits, so start lower for them)
+   */
+  for (prec = ((bits >> 52) & 0x7ff) ? 15 : 1; prec < 17; prec++) {
+    sprintf(tmp, "%.*e", prec - 1, d);
+    if (strtod(tmp, NULL) == d)
+      break;
+  }
+
+  if (prec == 17)
+    sprintf(tmp, "%.16e", d);
+
+  /* collect digits, ignoring the locale decimal point */
+  for (len = 0, s = tmp; *s != 'e'; s++)
+    if (*s >= '0' && *s <= '9')
+      digits[len++] = *s;
+
+  /* drop trailing zeros */
+  while (len > 1 && digits[len - 1] == '0')
+    len--;
+
+  /* return length */
+  return n + format_digits(dst + n, digits, len, atoi(s + 1));
+}
+
+/*
+ * begin_value() - Check that a value is allowed at this point, and
+ * write the separator before it (if any).
+ */
+static jf_err_t
+begin_value(jf_writer_t *w) {
+  jf_err_t err;
+
+  if (w->depth && IN_OBJECT(w)) {
+    /* object member values must follow a key */
+    if (!w->key)
+      return JF_ERR_INVALID_WRITE;
+    w->key = 0;
+  } else if (!w->first) {
+    /* write separator after previous value */
+    RESERVE(w, 1);
+    w->buf[w->buf_len++] = w->depth ? ',' : '\n';
+  }
+
+  /* clear first value flag */
+  w->first = 0;
+
+  /* return success */
+  return JF_OK;
+}
+
+/*
+ * begin_container() - Start an object or array.
+ */
+static jf_err_t
+begin_container(jf_writer_t *w, const int is_obj) {
+  jf_err_t err;
+
+  /* check for stack overflow */
+  if (w->depth >= 8 * sizeof(w->stack))
+    return JF_ERR_STACK_OVERFLOW;
+
+  /* write separator */
+  if ((err = begin_value(w)) != JF_OK)
+    return err;
+
+  /* write opening bracket */
+  RESERVE(w, 1);
+  w->buf[w->buf_len++] = is_obj ? '{' : '[';
+
+  /* set or clear bit for this level */
+  if (is_obj)
+    w->stack[w->depth >> 3] |= STACK_BIT(w->depth);
+  else
+    w->stack[w->depth >> 3] &= ~STACK_BIT(w->depth);
+
+  /* increment depth */
+  w->depth++;
+  w->first = 1;
+
+  /* return success */
+  return JF_OK;
+}
+
+/*
+ * end_container() - Finish an object or array.
+ */
+static jf_err_t
+end_container(jf_writer_t *w, const int is_obj) {
+  jf_err_t err;
+
+  /* check for stack underflow */
+  if (!w->depth)
+    return JF_ERR_STACK_UNDERFLOW;
+
+  /* check container type, and for a key without a value */
+  if (!IN_OBJECT(w) != !is_obj || w->key)
+    return JF_ERR_INVALID_WRITE;
+
+  /* write closing bracket */
+  RESERVE(w, 1);
+  w->buf[w->buf_len++] = is_obj ? '}' : ']';
+
+  /* decrement depth */
+  w->depth--;
+  w->first = 0;
+
+  /* return success */
+  return JF_OK;
+}
+
+void
+jf_writer_init(jf_writer_t *w) {
+  memset(w, 0, sizeof(jf_writer_t));
+  w->first = 1;
+}
+
+jf_err_t
+jf_writer_init_ex(jf_writer_t *w, uint8_t *buf, size_t buf_size, jf_writer_cb_t cb) {
+  /* check buffer size */
+  if (buf_size < JF_WRITER_MIN_BUF_LEN)
+    return JF_ERR_STORAGE_TOO_SMALL;
+
+  /* init writer */
+  jf_writer_init(w);
+  w->buf = buf;
+  w->buf_size = buf_size;
+  w->cb = cb;
+
+  /* return success */
+  return JF_OK;
+}
+
+void
+jf_writer_free(jf_writer_t *w) {
+  /* free growable buffer */
+  if (!w->cb && w->buf)
+    free(w->buf);
+
+  w->buf = NULL;
+  w->buf_len = w->buf_size = 0;
+}
+
+jf_err_t
+jf_writer_begin_object(jf_writer_t *w) {
+  return begin_container(w, 1);
+}
+
+jf_err_t
+jf_writer_end_object(jf_writer_t *w) {
+  return end_container(w, 1);
+}
+
+jf_err_t
+jf_writer_begin_array(jf_writer_t *w) {
+  return begin_container(w, 0);
+}
+
+jf_err_t
+jf_writer_end_array(jf_writer_t *w) {
+  return end_container(w, 0);
+}
+
+jf_err_t
+jf_writer_key(jf_writer_t *w, const uint8_t *str, size_t len) {
+  jf_err_t err;
+
+  /* keys are only allowed in objects, before each value */
+  if (!w->depth || !IN_OBJECT(w) || w->key)
+    return JF_ERR_INVALID_WRITE;
+
+  /* write separator after previous member */
+  if (!w->first) {
+    RESERVE(w, 1);
+    w->buf[w->buf_len++] = ',';
+  }
+
+  /* write key and colon */
+  if ((err = write_string(w, str, len)) != JF_OK)
+    return err;
+  RESERVE(w, 1);
+  w->buf[w->buf_len++] = ':';
+
+  /* expect value */
+  w->first = 0;
+  w->key = 1;
+
+  /* return success */
+  return JF_OK;
+}
+
+jf_err_t
+jf_writer_string(jf_writer_t *w, const uint8_t *str, size_t len) {
+  jf_err_t err;
+
+  if ((err = begin_value(w)) != JF_OK)
+    return err;
+
+  return write_string(w, str, len);
+}
+
+jf_err_t
+jf_writer_int(jf_writer_t *w, int64_t val) {
+  jf_err_t err;
+
+  if ((err = begin_value(w)) != JF_OK)
+    return err;
+
+  /* write sign and digits */
+  RESERVE(w, 21);
+  if (val < 0)
+    w->buf[w->buf_len++] = '-';
+  w->buf_len += format_uint(w->buf + w->buf_len, (val < 0) ? -(uint64_t) val : (uint64_t) val);
+
+  /* return success */
+  return JF_OK;
+}
+
+jf_err_t
+jf_writer_double(jf_writer_t *w, double val) {
+  uint8_t tmp[JF_WRITER_MIN_BUF_LEN];
+  size_t len;
+  jf_err_t err;
+
+  /* format number first, so NaN is rejected before anything is written */
+  if ((len = format_double(tmp, val)) == 0)
+    return JF_ERR_INVALID_WRITE;
+
+  if ((err = begin_value(w)) != JF_OK)
+    return err;
+
+  return write_bytes(w, tmp, len);
+}
+
+jf_err_t
+jf_writer_number(jf_writer_t *w, const uint8_t *str, size_t len) {
+  jf_err_t err;
+
+  if ((err = begin_value(w)) != JF_OK)
+    return err;
+
+  return write_bytes(w, str, len);
+}
+
+jf_err_t
+jf_writer_bool(jf_writer_t *w, int val) {
+  jf_err_t err;
+
+  if ((err = begin_value(w)) != JF_OK)
+    return err;
+
+  return val ? write_bytes(w, (const uint8_t*) "true", 4) :
+               write_bytes(w, (const uint8_t*) "false", 5);
+}
+
+jf_err_t
+jf_writer_null(jf_writer_t *w) {
+  jf_err_t err;
+
+  if ((err = begin_value(w)) != JF_OK)
+    return err;
+
+  return write_bytes(w, (const uint8_t*) "null", 4);
+}
+
+jf_err_t
+jf_writer_flush(jf_writer_t *w) {
+  jf_err_t err;
+
+  /* growable buffers are never flushed */
+  if (!w->cb || !w->buf_len)
+    return JF_OK;
+
+  /* pass buffer to callback */
+  if ((err = w->cb(w, w->buf, w->buf_len)) != JF_OK)
+    return err;
+
+  /* empty buffer */
+  w->buf_len = 0;
+
+  /* return success */
+  return JF_OK;
+}
+
+jf_err_t
+jf_writer_done(jf_writer_t *w) {
+  /* check for unclosed objects and arrays */
+  if (w->depth)
+    return JF_ERR_INVALID_WRITE;
+
+  return jf_writer_flush(w);
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <jiffy/jiffy.h>
+
+#define INPUT_ERR_MSG "ERROR: Couldn't open input file '%s': %s\n"
+#define NUM_TOKENS 1024
+
+static const char *
+type_names[] = {
+  "begin object",
+  "end object",
+  "begin array",
+  "end array",
+  "begin string",
+  "string fragment",
+  "end string",
+  "integer",
+  "float",
+  "true",
+  "false",
+  "null",
+  "end document",
+  "begin key",
+  "key fragment",
+  "end key"
+};
+
+static void
+print_error_and_die(jf_t *p, jf_err_t err) {
+  char buf[1024];
+
+  jf_strerror_r(err, buf, sizeof(buf));
+  fprintf(stderr, "ERROR: got \"%s\" at byte %lu\n", buf, p->num_bytes);
+
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  uint8_t buf[BUFSIZ], data[JF_BATCH_DATA_SIZE(NUM_TOKENS)];
+  jf_token_t tokens[NUM_TOKENS];
+  size_t i, len, ofs, num_read, counts[JF_TYPE_LAST];
+  jf_batch_t batch;
+  FILE *fh;
+  jf_err_t err;
+  jf_t p;
+
+  /* init parser */
+  jf_init(&p, NULL);
+
+  /* init batch */
+  batch.tokens = tokens;
+  batch.max_tokens = NUM_TOKENS;
+  batch.data = data;
+  batch.data_size = sizeof(data);
+
+  /* clear token counts */
+  memset(counts, 0, sizeof(counts));
+
+  /* handle command-line arguments */
+  if (argc > 1 && !strcmp(argv[1], "-i")) {
+    /* allow invalid UTF-8 and unpaired surrogates */
+    p.flags |= JF_FLAG_IGNORE_RFC3629;
+    argc--;
+    argv++;
+  }
+
+  if (argc < 2 || !strncmp("-", argv[1], 2)) {
+    fh = stdin;
+  } else if ((fh = fopen(argv[1], "rb")) == NULL) {
+    fprintf(stderr, INPUT_ERR_MSG, argv[1], strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  /* read input file */
+  while (!feof(fh) && (len = fread(buf, 1, sizeof(buf), fh)) > 0) {
+    /* parse chunk as a series of batches */
+    for (ofs = 0; ofs < len; ofs += num_read) {
+      err = jf_parse_batch(&p, &batch, buf + ofs, len - ofs, &num_read);
+      if (err != JF_OK)
+        print_error_and_die(&p, err);
+
+      /* make sure the batch data didn't overflow */
+      if (batch.data_len > batch.data_size) {
+        fprintf(stderr, "ERROR: batch data overflow at byte %lu\n", p.num_bytes);
+        return EXIT_FAILURE;
+      }
+
+      /* count tokens in batch */
+      for (i = 0; i < batch.num_tokens; i++)
+        counts[batch.tokens[i].type]++;
+    }
+  }
+
+  /* finish parsing */
+  if ((err = jf_done(&p)) != JF_OK)
+    print_error_and_die(&p, err);
+
+  /* close input file */
+  if (fh != stdin)
+    fclose(fh);
+
+  /* print token counts */
+  for (i = 0; i < JF_TYPE_LAST; i++)
+    printf("%s: %lu\n", type_names[i], counts[i]);
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
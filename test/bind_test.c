@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <jiffy/bind.h>
+
+#define INPUT_ERR_MSG "ERROR: Couldn't open input file '%s': %s\n"
+#define MAX_EVENTS 8
+
+/*
+ * Bind a JSON object like the one in data/events.json to a struct,
+ * then print the struct.
+ */
+
+typedef struct {
+  int64_t id;
+  char type[16];
+  double ts;
+  int ok;
+} event_t;
+
+typedef struct {
+  int64_t id;
+  char *login;
+} owner_t;
+
+typedef struct {
+  char *name;
+  int32_t version;
+  int enabled;
+  double ratio;
+  owner_t owner;
+  char comment[32];
+
+  event_t events[MAX_EVENTS];
+  size_t num_events;
+} config_t;
+
+static const jf_bind_field_t event_fields[] = {
+  JF_BIND_FIELD("id", event_t, id, JF_BIND_INT),
+  JF_BIND_STRING_FIELD("type", event_t, type),
+  JF_BIND_FIELD("ts", event_t, ts, JF_BIND_DOUBLE),
+  JF_BIND_FIELD("ok", event_t, ok, JF_BIND_BOOL),
+};
+
+static jf_bind_desc_t event_desc = JF_BIND_DESC(event_t, event_fields);
+
+static const jf_bind_field_t owner_fields[] = {
+  JF_BIND_FIELD("id", owner_t, id, JF_BIND_INT),
+  JF_BIND_FIELD("login", owner_t, login, JF_BIND_STRING_PTR),
+};
+
+static jf_bind_desc_t owner_desc = JF_BIND_DESC(owner_t, owner_fields);
+
+static const jf_bind_field_t config_fields[] = {
+  JF_BIND_FIELD("name", config_t, name, JF_BIND_STRING_PTR),
+  JF_BIND_FIELD("version", config_t, version, JF_BIND_INT32),
+  JF_BIND_FIELD("enabled", config_t, enabled, JF_BIND_BOOL),
+  JF_BIND_FIELD("ratio", config_t, ratio, JF_BIND_DOUBLE),
+  JF_BIND_OBJECT_FIELD("owner", config_t, owner, &owner_desc),
+  JF_BIND_STRING_FIELD("comment", config_t, comment),
+  JF_BIND_ARRAY_FIELD("events", config_t, events, num_events, &event_desc),
+};
+
+static jf_bind_desc_t config_desc = JF_BIND_DESC(config_t, config_fields);
+
+/* nested descriptor with a duplicate member name, which can't be bound */
+static const jf_bind_field_t bad_owner_fields[] = {
+  JF_BIND_FIELD("id", owner_t, id, JF_BIND_INT),
+  JF_BIND_FIELD("id", owner_t, id, JF_BIND_INT),
+};
+
+static jf_bind_desc_t bad_owner_desc = JF_BIND_DESC(owner_t, bad_owner_fields);
+
+static const jf_bind_field_t bad_config_fields[] = {
+  JF_BIND_FIELD("name", config_t, name, JF_BIND_STRING_PTR),
+  JF_BIND_OBJECT_FIELD("owner", config_t, owner, &bad_owner_desc),
+};
+
+static jf_bind_desc_t bad_config_desc = JF_BIND_DESC(config_t, bad_config_fields);
+
+static void
+print_error_and_die(jf_t *p, jf_err_t err) {
+  char buf[1024];
+
+  jf_strerror_r(err, buf, sizeof(buf));
+  fprintf(stderr, "ERROR: got \"%s\" at byte %lu\n", buf, p->num_bytes);
+
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  uint8_t buf[BUFSIZ], arena[1024];
+  const event_t *e;
+  config_t c;
+  size_t i, len;
+  FILE *fh;
+  jf_err_t err;
+  jf_bind_t b;
+  jf_t p;
+
+  /* check command-line arguments */
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s file\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  /* binding to a bad nested descriptor must fail every time */
+  for (i = 0; i < 2; i++) {
+    if (jf_bind_init(&b, &p, &bad_config_desc, &c, arena, sizeof(arena)) != JF_ERR_INVALID_KEYMAP) {
+      fprintf(stderr, "ERROR: bound struct with duplicate member names\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  /* set defaults */
+  memset(&c, 0, sizeof(config_t));
+  strcpy(c.comment, "(none)");
+
+  /* bind parser to struct */
+  if ((err = jf_bind_init(&b, &p, &config_desc, &c, arena, sizeof(arena))) != JF_OK)
+    print_error_and_die(&p, err);
+
+  /* open input file */
+  if (!strncmp("-", argv[1], 2)) {
+    fh = stdin;
+  } else if ((fh = fopen(argv[1], "rb")) == NULL) {
+    fprintf(stderr, INPUT_ERR_MSG, argv[1], strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  /* read input file */
+  while (!feof(fh) && (len = fread(buf, 1, sizeof(buf), fh)) > 0) {
+    if ((err = jf_parse(&p, buf, len)) != JF_OK)
+      print_error_and_die(&p, err);
+  }
+
+  /* finish parsing */
+  if ((err = jf_done(&p)) != JF_OK)
+    print_error_and_die(&p, err);
+
+  /* close input file */
+  if (fh != stdin)
+    fclose(fh);
+
+  /* print struct */
+  printf("name: \"%s\"\n", c.name ? c.name : "(null)");
+  printf("version: %d\n", (int) c.version);
+  printf("enabled: %d\n", c.enabled);
+  printf("ratio: %g\n", c.ratio);
+  printf("owner.id: %lld\n", (long long) c.owner.id);
+  printf("owner.login: \"%s\"\n", c.owner.login ? c.owner.login : "(null)");
+  printf("comment: \"%s\"\n", c.comment);
+
+  for (i = 0; i < c.num_events; i++) {
+    e = c.events + i;
+    printf("events[%lu]: id = %lld, type = \"%s\", ts = %.1f, ok = %d\n",
+           i, (long long) e->id, e->type, e->ts, e->ok);
+  }
+
+  printf("arena: %lu/%lu bytes\n", b.arena_len, b.arena_size);
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <jiffy/jiffy.h>
+
+#define INPUT_ERR_MSG "ERROR: Couldn't open input file '%s': %s\n"
+#define DEFAULT_CHUNK_SIZE 4096
+
+/*
+ * Parse a file twice: once in one pass, and once in chunks, saving a
+ * checkpoint after each chunk and restoring it into a fresh parser
+ * before the next one.  Both passes should produce the same tokens.
+ */
+
+typedef struct {
+  size_t num_tokens;
+  uint64_t hash;
+} state_t;
+
+static jf_err_t
+hash_cb(jf_t *p, jf_type_t type, const uint8_t *buf, size_t len) {
+  state_t *s = (state_t*) p->user_data;
+  size_t i;
+
+  /* hash token type and value (FNV-1a) */
+  s->hash = (s->hash ^ type) * 0x100000001b3ULL;
+  for (i = 0; i < len; i++)
+    s->hash = (s->hash ^ buf[i]) * 0x100000001b3ULL;
+
+  s->num_tokens++;
+
+  /* return success */
+  return JF_OK;
+}
+
+static void
+print_error_and_die(jf_t *p, jf_err_t err) {
+  char buf[1024];
+
+  jf_strerror_r(err, buf, sizeof(buf));
+  fprintf(stderr, "ERROR: got \"%s\" at byte %lu\n", buf, p->num_bytes);
+
+  exit(EXIT_FAILURE);
+}
+
+static uint8_t *
+read_file(const char *path, size_t *len) {
+  uint8_t *buf = NULL;
+  size_t size = 0;
+  FILE *fh;
+
+  if ((fh = fopen(path, "rb")) == NULL) {
+    fprintf(stderr, INPUT_ERR_MSG, path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  /* read file into buffer */
+  *len = 0;
+  do {
+    size = 2 * size + BUFSIZ;
+    if ((buf = realloc(buf, size)) == NULL) {
+      fprintf(stderr, "ERROR: out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+
+    *len += fread(buf + *len, 1, size - *len, fh);
+  } while (*len == size);
+
+  fclose(fh);
+
+  return buf;
+}
+
+int main(int argc, char *argv[]) {
+  uint8_t checkpoint[1024], *buf;
+  size_t ofs, len, chunk_size, cp_len, max_cp_len = 0, num_checkpoints = 0;
+  state_t full, chunked;
+  jf_err_t err;
+  jf_t p;
+
+  /* handle command-line arguments */
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s file [chunk_size]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  chunk_size = (argc > 2) ? strtoul(argv[2], NULL, 10) : DEFAULT_CHUNK_SIZE;
+  if (!chunk_size)
+    chunk_size = DEFAULT_CHUNK_SIZE;
+
+  /* read input file */
+  buf = read_file(argv[1], &len);
+
+  /* parse in one pass */
+  memset(&full, 0, sizeof(full));
+  jf_init(&p, hash_cb);
+  p.user_data = &full;
+  if ((err = jf_parse(&p, buf, len)) != JF_OK || (err = jf_done(&p)) != JF_OK)
+    print_error_and_die(&p, err);
+
+  /* parse in chunks */
+  memset(&chunked, 0, sizeof(chunked));
+  jf_init(&p, hash_cb);
+  p.user_data = &chunked;
+  for (ofs = 0; ofs < len; ofs = p.num_bytes) {
+    if ((err = jf_parse(&p, buf + ofs, (len - ofs < chunk_size) ? len - ofs : chunk_size)) != JF_OK)
+      print_error_and_die(&p, err);
+
+    /* save checkpoint */
+    if ((err = jf_checkpoint(&p, checkpoint, sizeof(checkpoint), &cp_len)) != JF_OK)
+      print_error_and_die(&p, err);
+    if (cp_len > max_cp_len)
+      max_cp_len = cp_len;
+    num_checkpoints++;
+
+    /* restore checkpoint into a fresh parser */
+    jf_init(&p, hash_cb);
+    p.user_data = &chunked;
+    if ((err = jf_restore(&p, checkpoint, cp_len)) != JF_OK)
+      print_error_and_die(&p, err);
+  }
+
+  /* finish parsing */
+  if ((err = jf_done(&p)) != JF_OK)
+    print_error_and_die(&p, err);
+
+  /* free input buffer */
+  free(buf);
+
+  /* print results */
+  printf("tokens: %lu\n", chunked.num_tokens);
+  printf("checkpoints: %lu\n", num_checkpoints);
+  printf("max checkpoint size: %lu bytes\n", max_cp_len);
+
+  if (full.num_tokens != chunked.num_tokens || full.hash != chunked.hash) {
+    fprintf(stderr, "ERROR: token streams differ (%lu != %lu)\n", full.num_tokens, chunked.num_tokens);
+    return EXIT_FAILURE;
+  }
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
@@ -4,17 +4,17 @@
 #include <string.h>
 #include <errno.h>
 
-#include <jiffy/jiffy.h>
+#include <jiffy/file.h>
 
-#define INPUT_ERR_MSG "ERROR: Couldn't open input file '%s': %s\n"
+#define INPUT_ERR_MSG "ERROR: Couldn't read input file '%s': %s\n"
 #define UNUSED(a) ((void) (a))
 
 static void 
 dump_stack(jf_t *p) {
   fprintf(
     stderr, 
-    "DEBUG: num_bytes = %lu, sp = %lu, stack = %s\n", 
-    p->num_bytes, p->sp, p->stack
+    "DEBUG: num_bytes = %lu, depth = %lu, state = '%c'\n", 
+    p->num_bytes, p->depth, p->state ? p->state : '0'
   );
 }
 
@@ -81,9 +81,7 @@ parse_cb(jf_t *p, jf_type_t type, const char *jf_buf, const size_t jf_buf_len) {
 }
 
 int main(int argc, char *argv[]) {
-  uint8_t buf[BUFSIZ];
-  size_t len;
-  FILE *fh;
+  const char *path = (argc < 2) ? "-" : argv[1];
   jf_err_t err;
   jf_t p;
 
@@ -91,33 +89,26 @@ int main(int argc, char *argv[]) {
   jf_init(&p, (jf_cb_t) parse_cb);
 
   /* handle command-line arguments */
-  if (argc < 2 || !strncmp("-", argv[1], 2)) {
+  if (!strncmp("-", path, 2)) {
     /* 
      * if there were no arguments or the first argument is a dash, 
      * then read input from stdin 
      */
-    fh = stdin;
-  } else if ((fh = fopen(argv[1], "rb")) == NULL) {
+    err = jf_parse_fd(&p, STDIN_FILENO);
+  } else {
+    err = jf_parse_file(&p, path);
+  }
+
+  if (err == JF_ERR_IO) {
     /* 
-     * if we couldn't open the input file, then print an error
+     * if we couldn't read the input file, then print an error
      * explaining why and exit
      */
-    fprintf(stderr, INPUT_ERR_MSG, argv[1], strerror(errno));
-    return EXIT_FAILURE;;
-  }
-  
-  /* read input file */
-  while (!feof(fh) && (len = fread(buf, 1, sizeof(buf), fh)) > 0)
-    if ((err = jf_parse(&p, buf, len)) != JF_OK)
-      print_error_and_die(&p, err);
-
-  /* finish parsing */
-  if ((err = jf_done(&p)) != JF_OK)
+    fprintf(stderr, INPUT_ERR_MSG, path, strerror(errno));
+    return EXIT_FAILURE;
+  } else if (err != JF_OK) {
     print_error_and_die(&p, err);
-  
-  /* close input file */
-  if (fh != stdin)
-    fclose(fh);
+  }
 
   /* return success */
   return EXIT_SUCCESS;
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <jiffy/jiffy.h>
+
+#define USAGE "Usage: %s path [path ...] < input.json\n"
+
+static const char *
+type_names[] = {
+  "begin object",
+  "end object",
+  "begin array",
+  "end array",
+  "begin string",
+  "string fragment",
+  "end string",
+  "integer",
+  "float",
+  "true",
+  "false",
+  "null",
+  "end document",
+  "begin key",
+  "key fragment",
+  "end key"
+};
+
+typedef struct {
+  jf_filter_t filter;
+  char **exprs;
+} ctx_t;
+
+static void
+print_error_and_die(jf_t *p, jf_err_t err) {
+  char buf[1024];
+
+  jf_strerror_r(err, buf, sizeof(buf));
+  fprintf(stderr, "ERROR: got \"%s\" at byte %lu\n", buf, p->num_bytes);
+
+  exit(EXIT_FAILURE);
+}
+
+static jf_err_t
+parse_cb(jf_t *p, jf_type_t type, const uint8_t *val, const size_t len) {
+  ctx_t *ctx = (ctx_t*) p->user_data;
+
+  /* print matching path, token type, and token value */
+  printf(
+    "%s: %s %.*s\n", 
+    ctx->exprs[ctx->filter.match], type_names[type], (int) len, val
+  );
+
+  return JF_OK;
+}
+
+int main(int argc, char *argv[]) {
+  jf_path_t paths[JF_MAX_PATHS];
+  uint8_t buf[BUFSIZ];
+  size_t len, num_paths;
+  jf_err_t err;
+  ctx_t ctx;
+  jf_t p;
+
+  /* check command-line arguments */
+  if (argc < 2) {
+    fprintf(stderr, USAGE, argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  /* compile paths */
+  for (num_paths = 0; num_paths < (size_t) argc - 1 && num_paths < JF_MAX_PATHS; num_paths++) {
+    if (jf_path_compile(paths + num_paths, argv[num_paths + 1]) != JF_OK) {
+      fprintf(stderr, "ERROR: invalid path: %s\n", argv[num_paths + 1]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  /* init filter */
+  jf_filter_init(&(ctx.filter), paths, num_paths);
+  ctx.exprs = argv + 1;
+
+  /* init parser and attach filter */
+  jf_init(&p, parse_cb);
+  p.user_data = &ctx;
+  jf_set_filter(&p, &(ctx.filter));
+
+  /* read input */
+  while (!feof(stdin) && (len = fread(buf, 1, sizeof(buf), stdin)) > 0)
+    if ((err = jf_parse(&p, buf, len)) != JF_OK)
+      print_error_and_die(&p, err);
+
+  /* finish parsing */
+  if ((err = jf_done(&p)) != JF_OK)
+    print_error_and_die(&p, err);
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
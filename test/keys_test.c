@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <jiffy/jiffy.h>
+
+#define INPUT_ERR_MSG "ERROR: Couldn't open input file '%s': %s\n"
+#define MAX_KEY_LEN 1024
+
+/*
+ * Parse a file with JF_FLAG_KEY_TOKENS set and a key table attached,
+ * and print the number of times each key in the table was seen.  Any
+ * keys given after the file name are added to the table first, so
+ * they get the first IDs.
+ *
+ * With -m, the keys given after the file name are put in a key map
+ * instead, and only those keys are counted.
+ *
+ * Each key is checked against its hash and its entry in the table or
+ * map.
+ */
+
+typedef struct {
+  jf_keys_t keys;
+  jf_keymap_t keymap;
+  jf_key_buf_t key_buf;
+  int use_keymap;
+  const char **names;
+
+  size_t counts[JF_MAX_KEYS], num_keys, num_other;
+
+  /* current key */
+  uint8_t key[MAX_KEY_LEN];
+  size_t key_len;
+} state_t;
+
+static jf_err_t
+keys_cb(jf_t *p, jf_type_t type, const uint8_t *buf, size_t len) {
+  state_t *s = (state_t*) p->user_data;
+  const uint8_t *key;
+  size_t i, key_len;
+
+  switch (type) {
+  case JF_TYPE_BGN_KEY:
+    s->key_len = 0;
+    break;
+  case JF_TYPE_KEY_FRAGMENT:
+    if (s->key_len + len > MAX_KEY_LEN)
+      len = MAX_KEY_LEN - s->key_len;
+    memcpy(s->key + s->key_len, buf, len);
+    s->key_len += len;
+    break;
+  case JF_TYPE_END_KEY:
+    s->num_keys++;
+
+    /* check key hash */
+    if (s->key_len < MAX_KEY_LEN && p->key_hash != jf_key_hash(s->key, s->key_len)) {
+      fprintf(stderr, "ERROR: bad hash for key \"%.*s\"\n", (int) s->key_len, s->key);
+      exit(EXIT_FAILURE);
+    }
+
+    if (p->key_id == JF_KEY_NONE) {
+      /* make sure the key isn't one of the key map keys */
+      for (i = 0; s->use_keymap && i < s->keymap.num_keys; i++) {
+        if (strlen(s->names[i]) == s->key_len && !memcmp(s->names[i], s->key, s->key_len)) {
+          fprintf(stderr, "ERROR: missed key \"%.*s\"\n", (int) s->key_len, s->key);
+          exit(EXIT_FAILURE);
+        }
+      }
+
+      s->num_other++;
+      break;
+    }
+
+    /* check key table or key map entry */
+    if (s->use_keymap) {
+      key = (const uint8_t*) s->names[p->key_id];
+      key_len = strlen(s->names[p->key_id]);
+    } else {
+      key = jf_keys_get(&(s->keys), p->key_id, &key_len);
+    }
+
+    if (!key || key_len != s->key_len || memcmp(key, s->key, key_len)) {
+      fprintf(stderr, "ERROR: bad ID for key \"%.*s\"\n", (int) s->key_len, s->key);
+      exit(EXIT_FAILURE);
+    }
+
+    s->counts[p->key_id]++;
+    break;
+  case JF_TYPE_BGN_STRING:
+  case JF_TYPE_STRING_FRAGMENT:
+  case JF_TYPE_END_STRING:
+    /* keys should never be sent as strings */
+    if (p->key) {
+      fprintf(stderr, "ERROR: got string token for key at byte %lu\n", p->num_bytes);
+      exit(EXIT_FAILURE);
+    }
+
+    break;
+  default:
+    /* ignore other tokens */
+    break;
+  }
+
+  /* return success */
+  return JF_OK;
+}
+
+static void
+print_error_and_die(jf_t *p, jf_err_t err) {
+  char buf[1024];
+
+  jf_strerror_r(err, buf, sizeof(buf));
+  fprintf(stderr, "ERROR: got \"%s\" at byte %lu\n", buf, p->num_bytes);
+
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  uint8_t buf[BUFSIZ];
+  const uint8_t *key;
+  size_t i, len, key_len, num_names;
+  const char *path;
+  state_t *s;
+  FILE *fh;
+  jf_err_t err;
+  jf_t p;
+
+  /* allocate state */
+  if ((s = calloc(1, sizeof(state_t))) == NULL) {
+    fprintf(stderr, "ERROR: out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  /* handle command-line arguments */
+  if (argc > 1 && !strcmp(argv[1], "-m")) {
+    s->use_keymap = 1;
+    argc--;
+    argv++;
+  }
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s [-m] file [keys...]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  path = argv[1];
+  s->names = (const char**) argv + 2;
+  num_names = argc - 2;
+
+  if (s->use_keymap) {
+    /* build key map */
+    if ((err = jf_keymap_init(&(s->keymap), s->names, num_names)) != JF_OK) {
+      fprintf(stderr, "ERROR: Couldn't build key map\n");
+      return EXIT_FAILURE;
+    }
+  } else {
+    /* add known keys */
+    jf_keys_init(&(s->keys));
+    for (i = 0; i < num_names; i++) {
+      if (jf_keys_add(&(s->keys), (uint8_t*) s->names[i], strlen(s->names[i]), NULL) != JF_OK) {
+        fprintf(stderr, "ERROR: Couldn't add key '%s'\n", s->names[i]);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  /* init parser */
+  jf_init(&p, keys_cb);
+  p.user_data = s;
+  p.flags = JF_FLAG_KEY_TOKENS;
+  if (s->use_keymap)
+    jf_set_keymap(&p, &(s->keymap), &(s->key_buf));
+  else
+    jf_set_keys(&p, &(s->keys), &(s->key_buf));
+
+  /* open input file */
+  if (!strncmp("-", path, 2)) {
+    fh = stdin;
+  } else if ((fh = fopen(path, "rb")) == NULL) {
+    fprintf(stderr, INPUT_ERR_MSG, path, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  /* read input file */
+  while (!feof(fh) && (len = fread(buf, 1, sizeof(buf), fh)) > 0) {
+    if ((err = jf_parse(&p, buf, len)) != JF_OK)
+      print_error_and_die(&p, err);
+  }
+
+  /* finish parsing */
+  if ((err = jf_done(&p)) != JF_OK)
+    print_error_and_die(&p, err);
+
+  /* close input file */
+  if (fh != stdin)
+    fclose(fh);
+
+  /* print key counts */
+  printf("keys: %lu\n", s->num_keys);
+  printf("keys not in %s: %lu\n", s->use_keymap ? "map" : "table", s->num_other);
+  for (i = 0; i < (s->use_keymap ? num_names : s->keys.num_keys); i++) {
+    if (s->use_keymap) {
+      key = (const uint8_t*) s->names[i];
+      key_len = strlen(s->names[i]);
+    } else {
+      key = jf_keys_get(&(s->keys), i, &key_len);
+    }
+
+    printf("%lu: \"%.*s\": %lu\n", i, (int) key_len, key, s->counts[i]);
+  }
+
+  /* free state */
+  free(s);
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <jiffy/mt.h>
+
+#define INPUT_ERR_MSG "ERROR: Couldn't open input file '%s': %s\n"
+#define USAGE "Usage: %s input.ndjson [num_threads]\n"
+
+typedef struct {
+  size_t num_docs, num_tokens;
+} counts_t;
+
+static void
+print_error_and_die(jf_t *p, jf_err_t err) {
+  char buf[1024];
+
+  jf_strerror_r(err, buf, sizeof(buf));
+  fprintf(stderr, "ERROR: got \"%s\" at byte %lu\n", buf, p->num_bytes);
+
+  exit(EXIT_FAILURE);
+}
+
+static jf_err_t
+parse_cb(jf_t *p, jf_type_t type, const uint8_t *val, const size_t len) {
+  counts_t *counts = (counts_t*) p->user_data;
+
+  (void) val;
+  (void) len;
+
+  /* count documents and tokens */
+  if (type == JF_TYPE_END_DOCUMENT)
+    counts->num_docs++;
+  else
+    counts->num_tokens++;
+
+  return JF_OK;
+}
+
+int main(int argc, char *argv[]) {
+  size_t len, size = BUFSIZ, num_threads;
+  uint8_t *buf = NULL;
+  counts_t counts;
+  jf_err_t err;
+  FILE *fh;
+  jf_t p;
+
+  /* check command-line arguments */
+  if (argc < 2) {
+    fprintf(stderr, USAGE, argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  /* get number of threads */
+  num_threads = (argc > 2) ? strtoul(argv[2], NULL, 10) : 4;
+
+  /* open input file */
+  if ((fh = fopen(argv[1], "rb")) == NULL) {
+    fprintf(stderr, INPUT_ERR_MSG, argv[1], strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  /* read input file */
+  for (len = 0; !feof(fh); len += fread(buf + len, 1, size - len, fh)) {
+    if ((buf = realloc(buf, size *= 2)) == NULL) {
+      fprintf(stderr, "ERROR: out of memory\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  fclose(fh);
+
+  /* init parser */
+  jf_init(&p, parse_cb);
+  memset(&counts, 0, sizeof(counts));
+  p.user_data = &counts;
+
+  /* parse records in parallel */
+  if ((err = jf_parse_ndjson_mt(&p, buf, len, num_threads)) != JF_OK)
+    print_error_and_die(&p, err);
+
+  /* print counts */
+  printf("documents: %lu\ntokens: %lu\n", counts.num_docs, counts.num_tokens);
+
+  /* free input */
+  free(buf);
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
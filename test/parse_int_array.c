@@ -3,6 +3,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <inttypes.h>
 
 #include <jiffy/jiffy.h>
 
@@ -35,8 +36,8 @@ run(jf_t *p, uint8_t *str, size_t str_len) {
 
 static jf_err_t
 parse_cb(jf_t *p, jf_type_t type, const char *val, const size_t val_len) {
-  char buf[JF_MAX_BUF_LEN];
-  UNUSED(p);
+  UNUSED(val);
+  UNUSED(val_len);
 
   switch (type) {
   case JF_TYPE_BGN_ARRAY:
@@ -59,12 +60,16 @@ parse_cb(jf_t *p, jf_type_t type, const char *val, const size_t val_len) {
     break;
   case JF_TYPE_INTEGER:
     if (capture > 0) {
-      /* populate and null-terminate buffer */
-      memcpy(buf, val, val_len);
-      buf[val_len] = '\0';
+      /* check for overflow */
+      if (p->num.flags & JF_NUM_OVERFLOW) {
+        fprintf(stderr, "ERROR: integer too large\n");
 
-      /* print integer */
-      printf("%s\n", buf);
+        /* stop parsing */
+        return JF_STOP;
+      }
+
+      /* print integer (converted by parser) */
+      printf("%" PRId64 "\n", p->num.i);
     } else {
       /* user entered a bare integer instead of an array */
       fprintf(stderr, "ERROR: bare integer (must be array of integers)\n");
@@ -93,8 +98,9 @@ int main(int argc, char *argv[]) {
   UNUSED(argc);
   UNUSED(argv);
 
-  /* init parser */
+  /* init parser and have it convert numbers for us */
   jf_init(&p, (jf_cb_t) parse_cb);
+  p.flags = JF_FLAG_CONVERT_NUMBERS;
   
   /* read and parse standard input */
   while (!feof(stdin) && (len = fread(buf, 1, sizeof(buf), stdin)) > 0)
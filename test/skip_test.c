@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <jiffy/jiffy.h>
+#include <jiffy/mt.h>
+
+#define USAGE "Usage: %s [-m] (-s | key [key ...]) < input.json\n"
+
+/*
+ * Parse standard input and print every token, except for the values
+ * of object members whose keys aren't given on the command line,
+ * which the callback skips by returning JF_SKIP.
+ *
+ * With -s, JF_FLAG_KEY_TOKENS is left off, and the callback skips
+ * every string instead.  Keys are sent as strings then, but they are
+ * never skipped, so only string values are dropped.
+ *
+ * With -m, the whole input is read first and parsed with
+ * jf_parse_mt(), which skips the same values (though string fragments
+ * may be split differently).
+ */
+
+static const char *
+type_names[] = {
+  "begin object",
+  "end object",
+  "begin array",
+  "end array",
+  "begin string",
+  "string fragment",
+  "end string",
+  "integer",
+  "float",
+  "true",
+  "false",
+  "null",
+  "end document",
+  "begin key",
+  "key fragment",
+  "end key"
+};
+
+static void
+print_error_and_die(jf_t *p, jf_err_t err) {
+  char buf[1024];
+
+  jf_strerror_r(err, buf, sizeof(buf));
+  fprintf(stderr, "ERROR: got \"%s\" at byte %lu\n", buf, p->num_bytes);
+
+  exit(EXIT_FAILURE);
+}
+
+static jf_err_t
+parse_cb(jf_t *p, jf_type_t type, const uint8_t *val, const size_t len) {
+  /* print token type and token value */
+  printf("%s %.*s\n", type_names[type], (int) len, val);
+
+  /* without key tokens (-s): skip strings (but not keys) */
+  if (!(p->flags & JF_FLAG_KEY_TOKENS))
+    return (type == JF_TYPE_BGN_STRING) ? JF_SKIP : JF_OK;
+
+  /* skip values of unknown keys */
+  return (type == JF_TYPE_END_KEY && p->key_id == JF_KEY_NONE) ? JF_SKIP : JF_OK;
+}
+
+int main(int argc, char *argv[]) {
+  uint8_t chunk[BUFSIZ], *buf = NULL;
+  size_t len, size = BUFSIZ;
+  jf_key_buf_t key_buf;
+  jf_keymap_t keymap;
+  int use_mt = 0;
+  jf_err_t err;
+  jf_t p;
+
+  /* init parser */
+  jf_init(&p, parse_cb);
+  p.flags = JF_FLAG_KEY_TOKENS;
+
+  /* handle command-line arguments */
+  if (argc > 1 && !strcmp(argv[1], "-m")) {
+    use_mt = 1;
+    argc--;
+    argv++;
+  }
+
+  if (argc > 1 && !strcmp(argv[1], "-s")) {
+    p.flags = 0;
+  } else if (argc < 2) {
+    fprintf(stderr, USAGE, argv[0]);
+    return EXIT_FAILURE;
+  } else {
+    /* build key map and attach it */
+    if (jf_keymap_init(&keymap, (const char**) argv + 1, argc - 1) != JF_OK) {
+      fprintf(stderr, "ERROR: Couldn't build key map\n");
+      return EXIT_FAILURE;
+    }
+
+    jf_set_keymap(&p, &keymap, &key_buf);
+  }
+
+  if (use_mt) {
+    /* read whole input */
+    for (len = 0; !feof(stdin); len += fread(buf + len, 1, size - len, stdin)) {
+      if ((buf = realloc(buf, size *= 2)) == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return EXIT_FAILURE;
+      }
+    }
+
+    /* parse input in parallel */
+    if ((err = jf_parse_mt(&p, buf, len, 4)) != JF_OK)
+      print_error_and_die(&p, err);
+
+    free(buf);
+  } else {
+    /* read input */
+    while (!feof(stdin) && (len = fread(chunk, 1, sizeof(chunk), stdin)) > 0)
+      if ((err = jf_parse(&p, chunk, len)) != JF_OK)
+        print_error_and_die(&p, err);
+
+    /* finish parsing */
+    if ((err = jf_done(&p)) != JF_OK)
+      print_error_and_die(&p, err);
+  }
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
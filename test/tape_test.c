@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include <jiffy/tape.h>
+
+#define INPUT_ERR_MSG "ERROR: Couldn't open input file '%s': %s\n"
+
+static void
+die(const char *msg) {
+  fprintf(stderr, "ERROR: %s\n", msg);
+  exit(EXIT_FAILURE);
+}
+
+static uint8_t *
+read_file(FILE *fh, size_t *ret_len) {
+  size_t len = 0, size = BUFSIZ;
+  uint8_t *buf = NULL;
+
+  while (!feof(fh)) {
+    if ((buf = realloc(buf, size *= 2)) == NULL)
+      die("out of memory");
+
+    len += fread(buf + len, 1, size - len, fh);
+  }
+
+  *ret_len = len;
+  return buf;
+}
+
+/* 
+ * print the value at the given tape index as compact JSON and return
+ * the index of the next value.
+ */
+static size_t
+print_value(const jf_tape_t *t, size_t i) {
+  const uint8_t *s;
+  size_t j, len, end;
+
+  switch (jf_tape_type(t, i)) {
+  case JF_TAPE_OBJECT:
+  case JF_TAPE_ARRAY:
+    putchar((jf_tape_type(t, i) == JF_TAPE_OBJECT) ? '{' : '[');
+
+    /* print children */
+    for (j = i + 1, end = jf_tape_next(t, i) - 1; j < end; ) {
+      if (j > i + 1)
+        putchar(',');
+
+      j = print_value(t, j);
+
+      /* print member value */
+      if (jf_tape_type(t, i) == JF_TAPE_OBJECT) {
+        putchar(':');
+        j = print_value(t, j);
+      }
+    }
+
+    putchar((jf_tape_type(t, i) == JF_TAPE_OBJECT) ? '}' : ']');
+    break;
+  case JF_TAPE_STRING:
+    s = jf_tape_string(t, i, &len);
+
+    putchar('"');
+    for (j = 0; j < len; j++) {
+      if (s[j] == '"' || s[j] == '\\')
+        printf("\\%c", s[j]);
+      else if (s[j] < 0x20)
+        printf("\\u%04x", s[j]);
+      else
+        putchar(s[j]);
+    }
+    putchar('"');
+
+    break;
+  case JF_TAPE_INTEGER:
+    printf("%" PRId64, jf_tape_int(t, i));
+    break;
+  case JF_TAPE_FLOAT:
+    printf("%.17g", jf_tape_float(t, i));
+    break;
+  case JF_TAPE_TRUE:
+    printf("true");
+    break;
+  case JF_TAPE_FALSE:
+    printf("false");
+    break;
+  case JF_TAPE_NULL:
+    printf("null");
+    break;
+  default:
+    die("invalid tape entry");
+  }
+
+  return jf_tape_next(t, i);
+}
+
+int main(int argc, char *argv[]) {
+  char err_buf[1024];
+  uint8_t *buf;
+  size_t len;
+  jf_tape_t t;
+  jf_err_t err;
+  FILE *fh;
+
+  /* handle command-line arguments */
+  if (argc < 2 || !strncmp("-", argv[1], 2)) {
+    fh = stdin;
+  } else if ((fh = fopen(argv[1], "rb")) == NULL) {
+    fprintf(stderr, INPUT_ERR_MSG, argv[1], strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  /* read input file */
+  buf = read_file(fh, &len);
+
+  /* close input file */
+  if (fh != stdin)
+    fclose(fh);
+
+  /* parse document */
+  if ((err = jf_tape_load(&t, buf, len)) != JF_OK) {
+    jf_strerror_r(err, err_buf, sizeof(err_buf));
+    die(err_buf);
+  }
+
+  /* print document */
+  print_value(&t, 0);
+  putchar('\n');
+
+  /* free tape and input */
+  jf_tape_free(&t);
+  free(buf);
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <jiffy/jiffy.h>
+
+#define INPUT_ERR_MSG "ERROR: Couldn't open input file '%s': %s\n"
+#define USAGE "Usage: %s [-n] input.json\n"
+
+int main(int argc, char *argv[]) {
+  size_t len, size = BUFSIZ, err_ofs;
+  uint8_t *buf = NULL;
+  uint32_t flags = 0;
+  char err_buf[1024];
+  const char *path;
+  jf_err_t err;
+  FILE *fh;
+
+  /* check command-line arguments */
+  if (argc > 2 && !strcmp(argv[1], "-n")) {
+    /* validate stream of documents */
+    flags |= JF_FLAG_NDJSON;
+    path = argv[2];
+  } else if (argc > 1) {
+    path = argv[1];
+  } else {
+    fprintf(stderr, USAGE, argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  /* open input file */
+  if ((fh = fopen(path, "rb")) == NULL) {
+    fprintf(stderr, INPUT_ERR_MSG, path, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  /* read input file */
+  for (len = 0; !feof(fh); len += fread(buf + len, 1, size - len, fh)) {
+    if ((buf = realloc(buf, size *= 2)) == NULL) {
+      fprintf(stderr, "ERROR: out of memory\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  fclose(fh);
+
+  /* validate input */
+  err = jf_validate(buf, len, flags, &err_ofs);
+
+  /* free input */
+  free(buf);
+
+  if (err != JF_OK) {
+    jf_strerror_r(err, err_buf, sizeof(err_buf));
+    printf("invalid: \"%s\" at byte %lu\n", err_buf, err_ofs);
+    return EXIT_FAILURE;
+  }
+
+  printf("valid\n");
+
+  /* return success */
+  return EXIT_SUCCESS;
+}
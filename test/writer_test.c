@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <jiffy/tape.h>
+#include <jiffy/writer.h>
+
+#define INPUT_ERR_MSG "ERROR: Couldn't open input file '%s': %s\n"
+
+/*
+ * Load a document into a tape and write it back out as compact JSON,
+ * once to standard output through a small flushed buffer, and once to
+ * a growable buffer.  The second copy is loaded into another tape,
+ * which should be identical to the first one.
+ */
+
+static void
+die(const char *msg) {
+  fprintf(stderr, "ERROR: %s\n", msg);
+  exit(EXIT_FAILURE);
+}
+
+static void
+die_err(jf_err_t err) {
+  char buf[1024];
+
+  jf_strerror_r(err, buf, sizeof(buf));
+  die(buf);
+}
+
+static uint8_t *
+read_file(FILE *fh, size_t *ret_len) {
+  size_t len = 0, size = BUFSIZ;
+  uint8_t *buf = NULL;
+
+  while (!feof(fh)) {
+    if ((buf = realloc(buf, size *= 2)) == NULL)
+      die("out of memory");
+
+    len += fread(buf + len, 1, size - len, fh);
+  }
+
+  *ret_len = len;
+  return buf;
+}
+
+static jf_err_t
+flush_cb(jf_writer_t *w, const uint8_t *buf, const size_t len) {
+  (void) w;
+
+  /* write buffer to standard output */
+  return (fwrite(buf, 1, len, stdout) == len) ? JF_OK : JF_ERR_IO;
+}
+
+/* 
+ * write the value at the given tape index and return the index of the
+ * next value.
+ */
+static size_t
+write_value(jf_writer_t *w, const jf_tape_t *t, size_t i) {
+  const uint8_t *s;
+  size_t j, len, end;
+  jf_err_t err;
+
+  switch (jf_tape_type(t, i)) {
+  case JF_TAPE_OBJECT:
+    if ((err = jf_writer_begin_object(w)) != JF_OK)
+      die_err(err);
+
+    /* write members */
+    for (j = i + 1, end = jf_tape_next(t, i) - 1; j < end; ) {
+      s = jf_tape_string(t, j, &len);
+      if ((err = jf_writer_key(w, s, len)) != JF_OK)
+        die_err(err);
+
+      j = write_value(w, t, jf_tape_next(t, j));
+    }
+
+    err = jf_writer_end_object(w);
+    break;
+  case JF_TAPE_ARRAY:
+    if ((err = jf_writer_begin_array(w)) != JF_OK)
+      die_err(err);
+
+    /* write elements */
+    for (j = i + 1, end = jf_tape_next(t, i) - 1; j < end; )
+      j = write_value(w, t, j);
+
+    err = jf_writer_end_array(w);
+    break;
+  case JF_TAPE_STRING:
+    s = jf_tape_string(t, i, &len);
+    err = jf_writer_string(w, s, len);
+    break;
+  case JF_TAPE_INTEGER:
+    err = jf_writer_int(w, jf_tape_int(t, i));
+    break;
+  case JF_TAPE_FLOAT:
+    err = jf_writer_double(w, jf_tape_float(t, i));
+    break;
+  case JF_TAPE_TRUE:
+  case JF_TAPE_FALSE:
+    err = jf_writer_bool(w, jf_tape_type(t, i) == JF_TAPE_TRUE);
+    break;
+  case JF_TAPE_NULL:
+    err = jf_writer_null(w);
+    break;
+  default:
+    die("invalid tape entry");
+  }
+
+  if (err != JF_OK)
+    die_err(err);
+
+  return jf_tape_next(t, i);
+}
+
+int main(int argc, char *argv[]) {
+  uint8_t out[64], *buf;
+  size_t len;
+  jf_tape_t t, t2;
+  jf_writer_t w;
+  jf_err_t err;
+  FILE *fh;
+
+  /* handle command-line arguments */
+  if (argc < 2 || !strncmp("-", argv[1], 2)) {
+    fh = stdin;
+  } else if ((fh = fopen(argv[1], "rb")) == NULL) {
+    fprintf(stderr, INPUT_ERR_MSG, argv[1], strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  /* read input file */
+  buf = read_file(fh, &len);
+
+  /* close input file */
+  if (fh != stdin)
+    fclose(fh);
+
+  /* parse document */
+  if ((err = jf_tape_load(&t, buf, len)) != JF_OK)
+    die_err(err);
+
+  /* write document to standard output */
+  if ((err = jf_writer_init_ex(&w, out, sizeof(out), flush_cb)) != JF_OK)
+    die_err(err);
+  write_value(&w, &t, 0);
+  if ((err = jf_writer_done(&w)) != JF_OK)
+    die_err(err);
+  putchar('\n');
+
+  /* write document to growable buffer and parse it again */
+  jf_writer_init(&w);
+  write_value(&w, &t, 0);
+  if ((err = jf_writer_done(&w)) != JF_OK || (err = jf_tape_load(&t2, w.buf, w.buf_len)) != JF_OK)
+    die_err(err);
+
+  /* compare tapes */
+  if (t.tape_len != t2.tape_len || t.strings_len != t2.strings_len ||
+      memcmp(t.tape, t2.tape, t.tape_len * sizeof(uint64_t)) ||
+      memcmp(t.strings, t2.strings, t.strings_len))
+    die("documents differ");
+
+  /* free writer, tapes, and input */
+  jf_writer_free(&w);
+  jf_tape_free(&t);
+  jf_tape_free(&t2);
+  free(buf);
+
+  /* return success */
+  return EXIT_SUCCESS;
+}